@@ -2,4 +2,4 @@
 
 // Please don't change the content of this header, it is auto generated by CMAKE
 
-#define PROJECT_SOURCE_DIR "C:/Users/parth/2021/CPSC-427/OpenGL_Started/"
+#define PROJECT_SOURCE_DIR "/root/repo/"
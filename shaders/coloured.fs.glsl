@@ -1,11 +1,12 @@
 #version 330
 
-uniform vec3 color;
+// From Vertex Shader
+in vec3 vcolor;
 
 // Output color
 layout(location = 0) out vec4 out_color;
 
 void main()
 {
-	out_color = vec4(color, 1.0);
+	out_color = vec4(vcolor, 1.0);
 }
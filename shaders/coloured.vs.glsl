@@ -1,16 +1,26 @@
 #version 330
 
 // !!! Simple shader for colouring basic meshes
+// Used for the DebugDraw lines, their vertices are in world coordinates
 
 // Input attributes
 in vec3 in_position;
+in vec3 in_color;
 
-// Application data
-uniform mat3 transform;
-uniform mat3 projection;
+out vec3 vcolor;
+
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
 
 void main()
 {
-	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
+	vcolor = in_color;
+	vec3 pos = projection * vec3(in_position.xy, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
 }
@@ -8,12 +8,21 @@ layout ( location = 4 ) in vec4 in_part_pos;
 out vec2 texCoord;
 // out vec4 particleColor;
 
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
+
 // Application data
 // uniform mat3 transform;
-uniform mat3 projection;
 // uniform vec4 color;
 uniform vec2 scale;
 uniform float angle;
+uniform vec4 uv_rect; // u0, v0, u1, v1 of the particle in the atlas
 
 void main()
 {
@@ -31,8 +40,12 @@ void main()
 	mat3 S = mat3(vec3(scale.x, 0.f, 0.f),vec3(0.f, scale.y, 0.f),vec3(0.f, 0.f, 1.f));
 	mat = mat * S;
 
-    texCoord = in_texcoord;
+    texCoord = mix(uv_rect.xy, uv_rect.zw, in_texcoord);
 	// particleColor = color;
 	vec3 pos = projection * mat * vec3(in_position.xy, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
+
+	// dead particles are moved out of the view volume and clipped
+	if (in_part_pos.w <= 0.0)
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
 }
\ No newline at end of file
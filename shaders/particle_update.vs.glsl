@@ -0,0 +1,79 @@
+#version 330
+
+// Particle state, written back through transform feedback
+layout ( location = 0 ) in vec4 in_position; // x, y, 1, life
+layout ( location = 1 ) in vec2 in_velocity;
+
+out vec4 out_position;
+out vec2 out_velocity;
+
+// Must match GpuParticles::MAX_BURSTS
+const int MAX_BURSTS = 4;
+
+// Application data
+uniform float elapsed_ms;
+uniform float life_ms;
+uniform uint step_seed;
+// Bursts spawned in this step, burst b respawns the particles [x, x + y) of burst_range[b]
+uniform int burst_count;
+uniform ivec2 burst_range[MAX_BURSTS];
+uniform vec2 burst_center[MAX_BURSTS];
+uniform uint burst_seed[MAX_BURSTS];
+
+uint hash(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+// in [0, 1)
+float random(inout uint state)
+{
+	state = hash(state);
+	return float(state >> 8) / 16777216.0;
+}
+
+// in [lo, hi], both included
+float randomInt(inout uint state, int lo, int hi)
+{
+	return float(lo + int(random(state) * float(hi - lo + 1)));
+}
+
+void main()
+{
+	vec4 position = in_position;
+	vec2 velocity = in_velocity;
+	uint id = uint(gl_VertexID);
+
+	for (int b = 0; b < burst_count; b++)
+	{
+		ivec2 range = burst_range[b];
+		if (gl_VertexID >= range.x && gl_VertexID < range.x + range.y)
+		{
+			// Same distribution as the bursts of the CPU particle pool
+			uint state = hash(burst_seed[b] ^ hash(id));
+			velocity.x = (randomInt(state, 0, 49) - 10.0) * 5.0 * 0.1;
+			velocity.y = (randomInt(state, 0, 49) - 10.0) * 5.0 * 0.1;
+			position.x = burst_center[b].x + (randomInt(state, 0, 99) - 50.0) / 10.0 + 20.0;
+			position.y = burst_center[b].y + (randomInt(state, 0, 199) - 100.0) / 10.0 + 40.0;
+			out_position = vec4(position.xy, 1.0, life_ms);
+			out_velocity = velocity;
+			return;
+		}
+	}
+
+	if (position.w > 0.0)
+	{
+		// jitter of 0..16 steps across the velocity
+		uint state = hash(step_seed ^ hash(id));
+		position.x -= velocity.y * floor(random(state) * 17.0) * 0.3;
+		position.y -= velocity.x * floor(random(state) * 17.0) * 0.3;
+		position.w -= elapsed_ms;
+	}
+	out_position = position;
+	out_velocity = velocity;
+}
@@ -1,15 +1,22 @@
 #version 330
 
 // From Vertex Shader
-in vec3 vcolor;
-
-// Application data
-uniform vec3 fcolor;
+in vec2 local_position;
+in float brightness;
 
 // Output color
 layout(location = 0) out vec4 color;
 
+// The colour the pebble meshes had
+const vec3 PEBBLE_COLOR = vec3(0.8);
+
 void main()
 {
-	color = vec4(fcolor * vcolor, 1.0);
+	// Signed distance to the edge, negative inside, faded out over one screen pixel
+	float distance = length(local_position) - 1.0;
+	float pixel = fwidth(distance);
+	float coverage = 1.0 - smoothstep(-0.5 * pixel, 0.5 * pixel, distance);
+	if (coverage <= 0.0)
+		discard;
+	color = vec4(brightness * PEBBLE_COLOR, coverage);
 }
\ No newline at end of file
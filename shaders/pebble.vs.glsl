@@ -1,18 +1,31 @@
 #version 330
 
-// Input attributes
-in vec3 in_color;
+// Input attributes, the corners of the unit sprite quad
 in vec3 in_position;
+// Per instance data (PebbleInstance)
+layout ( location = 2 ) in vec4 in_pebble; // center x, y, radius, brightness
 
-out vec3 vcolor;
+out vec2 local_position; // 0 at the center, length 1 on the edge
+out float brightness;
 
-// Application data
-uniform mat3 transform;
-uniform mat3 projection;
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
 
 void main()
 {
-	vcolor = in_color;
-	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
+	float radius = in_pebble.z;
+	// One pixel bigger than the circle, room for the anti-aliased edge
+	float extent = radius + 1.0;
+	vec2 offset = in_position.xy * 2.0 * extent;
+	local_position = offset / radius;
+	brightness = in_pebble.w;
+
+	vec3 pos = projection * vec3(in_pebble.xy + offset, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
 }
\ No newline at end of file
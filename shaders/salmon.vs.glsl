@@ -7,9 +7,17 @@ in vec3 in_color;
 out vec3 vcolor;
 out vec2 vpos;
 
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
+
 // Application data
 uniform mat3 transform;
-uniform mat3 projection;
 
 void main()
 {
@@ -2,10 +2,10 @@
 
 // From vertex shader
 in vec2 texcoord;
+in vec3 fcolor;
 
 // Application data
 uniform sampler2D sampler0;
-uniform vec3 fcolor;
 
 // Output color
 layout(location = 0) out  vec4 color;
@@ -1,19 +1,31 @@
 #version 330
 
 // Input attributes
-in vec3 in_position;
-in vec2 in_texcoord;
+layout ( location = 0 ) in vec3 in_position;
+layout ( location = 1 ) in vec2 in_texcoord;
+
+// Per instance attributes, one sprite each
+layout ( location = 2 ) in mat3 in_transform; // takes locations 2, 3 and 4
+layout ( location = 5 ) in vec3 in_color;
+layout ( location = 6 ) in vec4 in_uv_rect; // u0, v0, u1, v1 of the sprite in the atlas
 
 // Passed to fragment shader
 out vec2 texcoord;
+out vec3 fcolor;
 
-// Application data
-uniform mat3 transform;
-uniform mat3 projection;
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
 
 void main()
 {
-	texcoord = in_texcoord;
-	vec3 pos = projection * transform * vec3(in_position.xy, 1.0);
+	texcoord = mix(in_uv_rect.xy, in_uv_rect.zw, in_texcoord);
+	fcolor = in_color;
+	vec3 pos = projection * in_transform * vec3(in_position.xy, 1.0);
 	gl_Position = vec4(pos.xy, in_position.z, 1.0);
-}
\ No newline at end of file
+}
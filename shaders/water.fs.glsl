@@ -1,9 +1,14 @@
 #version 330
 
 uniform sampler2D screen_texture;
-uniform float time;
-uniform float darken_screen_factor;
-uniform int basic_mode;
+// Per frame data, shared by all effects (RenderSystem::FrameUniforms)
+layout(std140) uniform FrameData
+{
+	mat3 projection;
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+};
 in vec2 texcoord;
 
 layout(location = 0) out vec4 color;
@@ -1,5 +1,7 @@
 // internal
 #include "ai_system.hpp"
+#include "debug_draw.hpp"
+#include "spatial_index.hpp"
 #include "world_init.hpp"
 
 void AISystem::step(float elapsed_ms)
@@ -13,12 +15,19 @@ void AISystem::step(float elapsed_ms)
 	// if (internalFrameCounter % frameCounter == 0) {
 	if (registry.players.components.size() > 0) {
 		Motion& salmonMotion = registry.motions.get(registry.players.entities[0]);
-		for (auto& entity : registry.softShells.entities) {
+
+		// The fish closest to the salmon is the one it is after, that one dodges once in range
+		std::vector<Entity> nearest_fish = spatial_index.query_k_nearest(salmonMotion.position, 1,
+			[](Entity e) { return registry.softShells.has(e) && registry.motions.has(e); });
+		for (auto& entity : nearest_fish) {
 			Motion& fishMotion = registry.motions.get(entity);
 			vec2 d = salmonMotion.position - fishMotion.position;
 			float distance = sqrt(dot(d, d));
 			if (distance < AISystem::FISH_DELTA_DISTANCE) {
-				registry.softShells.get(entity).inDeltaRange = true;
+				SoftShell& softShell = registry.softShells.get(entity);
+				if (!softShell.inDeltaRange)
+					fishInDeltaRange.push_back(entity);
+				softShell.inDeltaRange = true;
 				// printf("fish and salmon have reached delta stage\n");
 				float angle = (180. / M_PI) * atan2(fishMotion.position.y - salmonMotion.position.y, fishMotion.position.x - salmonMotion.position.x);
 				// printf("angle: %f\n", angle);
@@ -32,13 +41,33 @@ void AISystem::step(float elapsed_ms)
 				}
 				AISystem::maybeDrawDeltaBox(&salmonMotion, &distance);
 			}
-			else {
-				 if (registry.softShells.get(entity).inDeltaRange) {
-				 fishMotion.velocity = { -200., 0. };
-				 }
+		}
+
+		// Fish that got close once swim straight on after leaving the range
+		fishInDeltaRange.erase(std::remove_if(fishInDeltaRange.begin(), fishInDeltaRange.end(),
+			[](Entity e) { return !registry.softShells.has(e); }), fishInDeltaRange.end());
+		for (auto& entity : fishInDeltaRange) {
+			Motion& fishMotion = registry.motions.get(entity);
+			vec2 d = salmonMotion.position - fishMotion.position;
+			if (dot(d, d) >= AISystem::FISH_DELTA_DISTANCE * AISystem::FISH_DELTA_DISTANCE) {
+				fishMotion.velocity = { -200., 0. };
 			}
 		}
 	}
+
+	// Fish swim around the turtles ahead of them, up or down whichever is shorter
+	for (uint i = 0; i < registry.softShells.size(); i++) {
+		Entity fish = registry.softShells.entities[i];
+		if (!registry.motions.has(fish))
+			continue;
+		Motion& fishMotion = registry.motions.get(fish);
+		RaycastHit hit;
+		if (spatial_index.raycast(fishMotion.position, fishMotion.velocity, AISystem::FISH_LOOKAHEAD_DISTANCE, hit,
+			[](Entity e) { return registry.hardShells.has(e) && registry.motions.has(e); })) {
+			const Motion& turtleMotion = registry.motions.get(hit.entity);
+			fishMotion.velocity.y = fishMotion.position.y < turtleMotion.position.y ? -AISystem::FISH_DODGE_SPEED : AISystem::FISH_DODGE_SPEED;
+		}
+	}
 	(void)elapsed_ms; // placeholder to silence unused warning until implemented
 }
 
@@ -46,17 +75,11 @@ void AISystem::step(float elapsed_ms)
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 // TODO A2: DRAW DEBUG INFO HERE on AI path
 // DON'T WORRY ABOUT THIS UNTIL ASSIGNMENT 2
-// You will want to use the createLine from world_init.hpp
+// Use the DebugDraw from debug_draw.hpp
 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
 void AISystem::maybeDrawDeltaBox(Motion* m_salmonMotion, float* m_distance) {
 	if (debugging.in_debug_mode && m_distance && m_salmonMotion) {
-		vec2 line_scale_vert = { m_salmonMotion->scale.x / 20, *m_distance * 2};
-		vec2 line_scale_hori = { *m_distance * 2, m_salmonMotion->scale.x / 20. };
-
-		Entity line1 = createLine({ m_salmonMotion->position.x, m_salmonMotion->position.y - *m_distance }, line_scale_hori);
-		Entity line2 = createLine({ m_salmonMotion->position.x, m_salmonMotion->position.y + *m_distance }, line_scale_hori);
-		Entity line3 = createLine({ m_salmonMotion->position.x + *m_distance, m_salmonMotion->position.y }, line_scale_vert);
-		Entity line4 = createLine({ m_salmonMotion->position.x - *m_distance, m_salmonMotion->position.y }, line_scale_vert);
+		debug_draw.box(m_salmonMotion->position, { *m_distance * 2, *m_distance * 2 });
 	}
 }
\ No newline at end of file
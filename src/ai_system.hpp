@@ -17,8 +17,15 @@ public:
 	void maybeDrawDeltaBox(Motion* m_salmonMotion, float* m_distance);
 
 	const float FISH_DELTA_DISTANCE = 200;	
+	// How far ahead fish look for turtles, and how fast they swim around one
+	const float FISH_LOOKAHEAD_DISTANCE = 250;
+	const float FISH_DODGE_SPEED = 180;
 
 	int frameCounter = 0;
 
 	int internalFrameCounter = -1;
+
+private:
+	// Fish with SoftShell::inDeltaRange set, so that they don't have to be searched for
+	std::vector<Entity> fishInDeltaRange;
 };
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "common.hpp"
 
+// stlib
+#include <cassert>
+#include <cstring>
+
 // Note, we could also use the functions from GLM but we write the transformations here to show the uderlying math
 void Transform::scale(vec2 scale)
 {
@@ -21,8 +25,53 @@ void Transform::translate(vec2 offset)
 	mat = mat * T;
 }
 
+bool gl_has_extension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+			return true;
+	return false;
+}
+
+#if GL_CHECK_ERRORS
+namespace {
+	// Set once the driver reports the errors through the debug callback
+	bool debug_output_enabled = false;
+
+	void APIENTRY debugMessageCallback(GLenum, GLenum type, GLuint, GLenum severity,
+		GLsizei, const GLchar* message, const void*)
+	{
+		if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+			return;
+		fprintf(stderr, "OpenGL: %s\n", message);
+		// synchronous output, the offending call is on the stack
+		assert(type != GL_DEBUG_TYPE_ERROR);
+	}
+}
+
+bool gl_enable_debug_output()
+{
+	GLint flags = 0;
+	glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+	if (!(flags & GL_CONTEXT_FLAG_DEBUG_BIT) || glDebugMessageCallback == nullptr)
+		return false;
+	if (!gl3w_is_supported(4, 3) && !gl_has_extension("GL_KHR_debug"))
+		return false;
+
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessageCallback, nullptr);
+	debug_output_enabled = true;
+	return true;
+}
+
 bool gl_has_errors()
 {
+	if (debug_output_enabled)
+		return false;
+
 	GLenum error = glGetError();
 
 	if (error == GL_NO_ERROR) return false;
@@ -55,4 +104,10 @@ bool gl_has_errors()
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+#else
+bool gl_enable_debug_output()
+{
+	return false;
+}
+#endif
@@ -44,4 +44,27 @@ struct Transform {
 	void translate(vec2 offset);
 };
 
+// Compile time switch of the GL error checks, on in debug builds. glGetError can stall
+// the driver, so release builds don't check at all.
+#ifndef GL_CHECK_ERRORS
+#ifdef NDEBUG
+#define GL_CHECK_ERRORS 0
+#else
+#define GL_CHECK_ERRORS 1
+#endif
+#endif
+
+// Reports the errors of the previous GL calls. When the debug output of the driver is
+// on it reports errors as they happen and this does nothing.
+#if GL_CHECK_ERRORS
 bool gl_has_errors();
+#else
+inline bool gl_has_errors() { return false; }
+#endif
+
+// Installs a KHR_debug message callback if the context is a debug context that
+// supports it, returns false otherwise. Does nothing unless GL_CHECK_ERRORS is on.
+bool gl_enable_debug_output();
+
+// True if the current context lists the extension, e.g. "GL_ARB_buffer_storage"
+bool gl_has_extension(const char* name);
@@ -3,6 +3,8 @@
 #include <vector>
 #include <unordered_map>
 #include "../ext/stb_image/stb_image.h"
+#include "sprite_mask.hpp"
+#include "timer_wheel.hpp"
 
 // Player component
 struct Player
@@ -24,6 +26,9 @@ struct Physics
 	// 2 pixels per millisecond^2
 	float gravityAccel = 0.2;
 	bool affectedByGravity = false;
+	// Bodies at rest are put to sleep by the contact solver and skipped until hit
+	bool asleep = false;
+	float sleep_timer_ms = 0.f;
 };
 
 // Fish and Salmon have a soft shell
@@ -44,6 +49,16 @@ struct Motion {
 	float angle = 0;
 	vec2 velocity = { 0, 0 };
 	vec2 scale = { 10, 10 };
+	// State at the start of the last simulation tick, the renderer interpolates towards the current one
+	vec2 prev_position = { 0, 0 };
+	float prev_angle = 0;
+};
+
+// Contacts are tracked across steps, gameplay usually only cares about new ones
+enum class CONTACT_PHASE {
+	BEGIN = 0,
+	PERSIST = BEGIN + 1,
+	END = PERSIST + 1
 };
 
 // Stucture to store collision information
@@ -51,7 +66,8 @@ struct Collision
 {
 	// Note, the first object is stored in the ECS container.entities
 	Entity other; // the second object involved in the collision
-	Collision(Entity& other) { this->other = other; };
+	CONTACT_PHASE phase = CONTACT_PHASE::BEGIN;
+	Collision(Entity& other, CONTACT_PHASE phase) { this->other = other; this->phase = phase; };
 };
 
 // Data structure for toggling debug mode
@@ -67,22 +83,37 @@ struct ScreenState
 	float darken_screen_factor = -1;
 };
 
-// A struct to refer to debugging graphics in the ECS
-struct DebugComponent
+// Kinds of entities that are spawned so often that their ids are recycled
+enum class ARCHETYPE_ID {
+	FISH = 0,
+	TURTLE = FISH + 1,
+	PEBBLE = TURTLE + 1,
+	ARCHETYPE_COUNT = PEBBLE + 1
+};
+const int archetype_count = (int)ARCHETYPE_ID::ARCHETYPE_COUNT;
+
+// Entities created by the EntityPools, they have to be removed through them too
+struct Pooled
 {
-	// Note, an empty struct has size 1
+	ARCHETYPE_ID archetype = ARCHETYPE_ID::ARCHETYPE_COUNT;
 };
 
-// A timer that will be associated to dying salmon
+// Associated to dying salmon, the game restarts at end_ms (time of the WorldSystem timers)
 struct DeathTimer
 {
-	float counter_ms = 3000;
+	float end_ms = 0.f;
 };
 
-// A timer that will be associated to fish eating salmon
+// Entities that are removed once their time is up, e.g. pebbles
+struct Lifetime
+{
+	float remaining_ms = 0.f;
+};
+
+// Associated to fish eating salmon, removed by a scheduled timer
 struct LightUpTimer
 {
-	float counter_ms = 1000;
+	TimerId removal = 0;
 };
 
 // Single Vertex Buffer element for non-textured meshes (coloured.vs.glsl & salmon.vs.glsl)
@@ -113,23 +144,12 @@ struct Mode
 	bool basicMode = true;
 };
 
-// Particles emitted during death
-struct DeathParticle
+// Particles emitted during death, a range of the ParticlePool
+struct ParticleEmitter
 {
-	Motion motion;
-	glm::vec4 Color;
-	float     Life;
-	std::vector<DeathParticle> deathParticles;
-	int fadedParticles = 0;
-	float positions[1000 * 4];
-	bool faded;
-	float angle;
-
-	DeathParticle()
-		: Color(1.0f), Life(1500.f), faded(false), angle(0.) {
-		motion.velocity.x = (float)((rand() % 50 - 10) * 5);
-		motion.velocity.y = (float)((rand() % 50 - 10) * 5);
-	}
+	unsigned int first = 0;
+	unsigned int count = 0;
+	float angle = 0.f;
 };
 
 /**
@@ -179,15 +199,23 @@ const int effect_count = (int)EFFECT_ASSET_ID::EFFECT_COUNT;
 enum class GEOMETRY_BUFFER_ID {
 	SALMON = 0,
 	SPRITE = SALMON + 1,
-	PEBBLE = SPRITE + 1,
-	DEBUG_LINE = PEBBLE + 1,
+	DEBUG_LINE = SPRITE + 1,
 	SCREEN_TRIANGLE = DEBUG_LINE + 1,
 	GEOMETRY_COUNT = SCREEN_TRIANGLE + 1
 };
 const int geometry_count = (int)GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
 
+// Coarsest draw order, a layer is drawn entirely before the next one
+enum class RENDER_LAYER {
+	BACKGROUND = 0,
+	WORLD = BACKGROUND + 1,
+	FOREGROUND = WORLD + 1,
+	LAYER_COUNT = FOREGROUND + 1
+};
+
 struct RenderRequest {
 	TEXTURE_ASSET_ID used_texture = TEXTURE_ASSET_ID::TEXTURE_COUNT;
 	EFFECT_ASSET_ID used_effect = EFFECT_ASSET_ID::EFFECT_COUNT;
 	GEOMETRY_BUFFER_ID used_geometry = GEOMETRY_BUFFER_ID::GEOMETRY_COUNT;
+	RENDER_LAYER used_layer = RENDER_LAYER::WORLD;
 };
\ No newline at end of file
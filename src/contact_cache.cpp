@@ -0,0 +1,61 @@
+// internal
+#include "contact_cache.hpp"
+#include "tiny_ecs_registry.hpp"
+
+namespace {
+	// Entity 0 is never handed out, so it stands in for the floor
+	uint64_t pairKey(unsigned int a, unsigned int b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return ((uint64_t)a << 32) | b;
+	}
+}
+
+CachedContact& ContactCache::touch(Entity e1, Entity e2)
+{
+	unsigned int id1 = e1;
+	unsigned int id2 = e2;
+	auto it = contacts.find(pairKey(id1, id2));
+	if (it == contacts.end())
+		it = contacts.emplace(pairKey(id1, id2), id1 < id2 ? CachedContact(e1, e2) : CachedContact(e2, e1)).first;
+	it->second.touched = true;
+	it->second.sleeping = false;
+	return it->second;
+}
+
+CachedContact& ContactCache::touchFloor(Entity e)
+{
+	auto it = contacts.find(pairKey(0, e));
+	if (it == contacts.end()) {
+		it = contacts.emplace(pairKey(0, e), CachedContact(e, e)).first;
+		it->second.with_floor = true;
+	}
+	it->second.touched = true;
+	it->second.sleeping = false;
+	return it->second;
+}
+
+void ContactCache::endStep()
+{
+	for (auto it = contacts.begin(); it != contacts.end();) {
+		CachedContact& contact = it->second;
+
+		// Resting pairs are not re-tested, they last until one of them is removed
+		bool alive = contact.touched ||
+			(contact.sleeping && registry.motions.has(contact.a) && registry.motions.has(contact.b));
+
+		if (!alive) {
+			if (!contact.with_floor)
+				registry.collisions.emplace_with_duplicates(contact.a, contact.b, CONTACT_PHASE::END);
+			it = contacts.erase(it);
+			continue;
+		}
+
+		if (contact.touched && !contact.with_floor)
+			registry.collisions.emplace_with_duplicates(contact.a, contact.b, contact.is_new ? CONTACT_PHASE::BEGIN : CONTACT_PHASE::PERSIST);
+		contact.is_new = false;
+		contact.touched = false;
+		++it;
+	}
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "common.hpp"
+#include "components.hpp"
+
+// State of a touching pair that is kept for as long as the contact lasts
+struct CachedContact
+{
+	Entity a; // the entity with the lower id
+	Entity b; // equal to a for contacts with the floor
+	bool with_floor = false;
+
+	vec2 point = { 0, 0 };
+	vec2 normal = { 0, 1 }; // from a to b
+	float normal_impulse = 0.f; // accumulated by the solver, warm starts the next step
+	float tangent_impulse = 0.f;
+
+	// Both bodies are asleep, the pair is not tested but the contact is kept alive
+	bool sleeping = false;
+
+	CachedContact(Entity a, Entity b) : a(a), b(b) {};
+
+private:
+	friend class ContactCache;
+	bool is_new = true;
+	bool touched = true;
+};
+
+// Persistent contact pairs keyed by the ordered entity pair. Each step the physics
+// touches the pairs that overlap, at the end of the step the cache reports a single
+// begin, persist or end event per pair into registry.collisions.
+class ContactCache
+{
+public:
+	// Marks the pair as touching in this step and returns its persistent state
+	CachedContact& touch(Entity e1, Entity e2);
+	CachedContact& touchFloor(Entity e);
+
+	// Emits the contact events of this step and forgets the contacts that ended
+	void endStep();
+
+	void clear() { contacts.clear(); }
+	size_t size() const { return contacts.size(); }
+
+private:
+	std::unordered_map<uint64_t, CachedContact> contacts;
+};
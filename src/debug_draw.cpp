@@ -0,0 +1,40 @@
+// internal
+#include "debug_draw.hpp"
+
+DebugDraw debug_draw;
+
+constexpr vec3 DebugDraw::RED;
+
+void DebugDraw::line(vec2 from, vec2 to, vec3 color)
+{
+	line_vertices.push_back({ vec3(from, 0.f), color });
+	line_vertices.push_back({ vec3(to, 0.f), color });
+}
+
+void DebugDraw::box(vec2 center, vec2 size, vec3 color)
+{
+	const vec2 min = center - size / 2.f;
+	const vec2 max = center + size / 2.f;
+	line({ min.x, min.y }, { max.x, min.y }, color);
+	line({ max.x, min.y }, { max.x, max.y }, color);
+	line({ max.x, max.y }, { min.x, max.y }, color);
+	line({ min.x, max.y }, { min.x, min.y }, color);
+}
+
+void DebugDraw::circle(vec2 center, float radius, vec3 color, int segments)
+{
+	vec2 previous = center + vec2(radius, 0.f);
+	for (int i = 1; i <= segments; i++) {
+		const float t = 2.f * M_PI * (float)i / (float)segments;
+		const vec2 next = center + radius * vec2(cosf(t), sinf(t));
+		line(previous, next, color);
+		previous = next;
+	}
+}
+
+void DebugDraw::point(vec2 position, float size, vec3 color)
+{
+	const float half = size / 2.f;
+	line({ position.x - half, position.y }, { position.x + half, position.y }, color);
+	line({ position.x, position.y - half }, { position.x, position.y + half }, color);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "components.hpp"
+
+// Immediate mode debug visualisation. Every shape is appended as line segments to a
+// CPU buffer, the renderer streams that buffer and draws it with a single GL_LINES
+// call. Nothing is added to the ECS, so debug drawing doesn't touch the simulation.
+// The shapes of a simulation step are drawn until the next step clears them.
+class DebugDraw
+{
+public:
+	static constexpr vec3 RED = { 0.8f, 0.1f, 0.1f };
+
+	void line(vec2 from, vec2 to, vec3 color = RED);
+	// Axis aligned box around 'center'
+	void box(vec2 center, vec2 size, vec3 color = RED);
+	void circle(vec2 center, float radius, vec3 color = RED, int segments = 24);
+	// A small cross of 'size' pixels
+	void point(vec2 position, float size = 6.f, vec3 color = RED);
+
+	// Drops the shapes, called at the start of every simulation step
+	void clear() { line_vertices.clear(); }
+
+	// Two vertices per segment, in world coordinates
+	const std::vector<ColoredVertex>& vertices() const { return line_vertices; }
+
+private:
+	std::vector<ColoredVertex> line_vertices;
+};
+
+extern DebugDraw debug_draw;
@@ -0,0 +1,56 @@
+// internal
+#include "despawn_system.hpp"
+#include "entity_pool.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// stlib
+#include <vector>
+
+namespace {
+	// Entities that are entirely inside one of these boxes are removed
+	struct DespawnVolume
+	{
+		vec2 min;
+		vec2 max;
+	};
+}
+
+void DespawnSystem::step(float elapsed_ms, vec2 screen_size)
+{
+	std::vector<Entity> expired;
+	for (uint i = 0; i < registry.lifetimes.size(); i++) {
+		Lifetime& lifetime = registry.lifetimes.components[i];
+		lifetime.remaining_ms -= elapsed_ms;
+		if (lifetime.remaining_ms <= 0.f)
+			expired.push_back(registry.lifetimes.entities[i]);
+	}
+
+	// The screen is surrounded by despawn volumes. Entities leave on the left side as
+	// soon as they are out of sight, the other sides leave some room.
+	const float far = 1e9f;
+	const DespawnVolume volumes[] = {
+		{ { -far, -far }, { 0.f, far } },
+		{ { screen_size.x + DESPAWN_MARGIN_PX, -far }, { far, far } },
+		{ { -far, -far }, { far, -DESPAWN_MARGIN_PX } },
+		{ { -far, screen_size.y + DESPAWN_MARGIN_PX }, { far, far } },
+	};
+
+	// One pass over all motions, each tested against all volumes without branches
+	auto& motions_registry = registry.motions;
+	const size_t motion_count = motions_registry.size();
+	for (size_t i = 0; i < motion_count; i++) {
+		const Motion& motion = motions_registry.components[i];
+		const vec2 half_extent = abs(motion.scale) * 0.5f;
+		const vec2 lower = motion.position - half_extent;
+		const vec2 upper = motion.position + half_extent;
+		bool outside = false;
+		for (const DespawnVolume& volume : volumes)
+			outside |= (lower.x > volume.min.x) & (upper.x < volume.max.x) & (lower.y > volume.min.y) & (upper.y < volume.max.y);
+		// the salmon is never removed, it dies instead
+		if (outside && !registry.players.has(motions_registry.entities[i]))
+			expired.push_back(motions_registry.entities[i]);
+	}
+
+	for (Entity entity : expired)
+		entity_pools.despawn(entity);
+}
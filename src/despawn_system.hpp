@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.hpp"
+
+// How far entities can go beyond the top, right and bottom edge before they are removed.
+// Fish, turtles and vortices spawn right of the screen, inside this margin.
+const float DESPAWN_MARGIN_PX = 200.f;
+
+// Removes entities whose lifetime is over or that left the world, so that the number
+// of entities stays bounded however long the game runs
+class DespawnSystem
+{
+public:
+	void step(float elapsed_ms, vec2 screen_size);
+};
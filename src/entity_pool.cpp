@@ -0,0 +1,43 @@
+// internal
+#include "entity_pool.hpp"
+#include "tiny_ecs_registry.hpp"
+
+EntityPools entity_pools;
+
+void EntityPools::reserve(size_t count)
+{
+	registry.reserve_all_components(count);
+	for (int i = 0; i < archetype_count; i++) {
+		free_ids[i].reserve(count);
+		for (int step = 0; step < QUARANTINE_STEPS; step++)
+			quarantined_ids[step][i].reserve(count);
+	}
+}
+
+Entity EntityPools::acquire(ARCHETYPE_ID archetype)
+{
+	std::vector<unsigned int>& ids = free_ids[(int)archetype];
+	Entity entity = ids.empty() ? Entity() : Entity(ids.back());
+	if (!ids.empty())
+		ids.pop_back();
+	registry.pooled.insert(entity, { archetype });
+	return entity;
+}
+
+void EntityPools::despawn(Entity entity)
+{
+	if (registry.pooled.has(entity))
+		quarantined_ids[newest][(int)registry.pooled.get(entity).archetype].push_back(entity);
+	registry.remove_all_components_of(entity);
+}
+
+void EntityPools::endStep()
+{
+	// The oldest set has waited long enough and becomes the newest
+	newest = (newest + 1) % QUARANTINE_STEPS;
+	for (int i = 0; i < archetype_count; i++) {
+		std::vector<unsigned int>& released = quarantined_ids[newest][i];
+		free_ids[i].insert(free_ids[i].end(), released.begin(), released.end());
+		released.clear();
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "components.hpp"
+#include "tiny_ecs.hpp"
+
+// Recycles the entities of the frequently spawned archetypes. A despawned entity keeps
+// its id, and since the containers keep their capacity, spawning it again doesn't
+// allocate. Ids wait a couple of steps before they are handed out again, so that the
+// systems that still refer to the old entity (contact cache, AI) see it removed first.
+class EntityPools
+{
+public:
+	// endStep calls before a despawned id is handed out again
+	static const int QUARANTINE_STEPS = 2;
+
+	// Reserves the components of 'count' entities in every container and room for as many
+	// recycled ids, so spawning up to that many entities doesn't allocate
+	void reserve(size_t count);
+
+	// A recycled or new entity with a Pooled component
+	Entity acquire(ARCHETYPE_ID archetype);
+
+	// Removes all components of the entity, its id is recycled if it is pooled
+	void despawn(Entity entity);
+
+	// Called once per step, ids despawned QUARANTINE_STEPS calls ago can be reused
+	void endStep();
+
+	size_t reusable(ARCHETYPE_ID archetype) const { return free_ids[(int)archetype].size(); }
+
+private:
+	std::array<std::vector<unsigned int>, archetype_count> free_ids;
+	// One set of ids per step of the quarantine, 'newest' receives the despawned ones
+	std::array<std::vector<unsigned int>, archetype_count> quarantined_ids[QUARANTINE_STEPS];
+	int newest = 0;
+};
+
+extern EntityPools entity_pools;
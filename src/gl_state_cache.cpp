@@ -0,0 +1,88 @@
+// internal
+#include "gl_state_cache.hpp"
+
+// stlib
+#include <cassert>
+
+void GlStateCache::invalidate()
+{
+	state = State();
+}
+
+void GlStateCache::beginFrame()
+{
+	invalidate();
+	frame_counters = Counters();
+}
+
+bool GlStateCache::change(bool differs)
+{
+	if (differs)
+		frame_counters.issued++;
+	else
+		frame_counters.elided++;
+	return differs;
+}
+
+void GlStateCache::useProgram(GLuint program)
+{
+	if (change(state.program != program)) {
+		glUseProgram(program);
+		state.program = program;
+	}
+}
+
+void GlStateCache::bindVertexArray(GLuint vao)
+{
+	if (change(state.vao != vao)) {
+		glBindVertexArray(vao);
+		state.vao = vao;
+		// every VAO has its own index buffer binding
+		state.element_buffer = UNKNOWN;
+	}
+}
+
+void GlStateCache::bindBuffer(GLenum target, GLuint buffer)
+{
+	assert(target == GL_ARRAY_BUFFER || target == GL_ELEMENT_ARRAY_BUFFER);
+	GLuint& bound = target == GL_ARRAY_BUFFER ? state.array_buffer : state.element_buffer;
+	if (change(bound != buffer)) {
+		glBindBuffer(target, buffer);
+		bound = buffer;
+	}
+}
+
+void GlStateCache::bindTexture(int unit, GLuint texture)
+{
+	assert(unit >= 0 && unit < TEXTURE_UNITS);
+	if (!change(state.textures[unit] != texture))
+		return;
+	if (state.active_unit != (GLuint)unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		state.active_unit = unit;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	state.textures[unit] = texture;
+}
+
+void GlStateCache::setBlend(bool enabled, GLenum src, GLenum dst)
+{
+	if (change(state.blend != (int)enabled)) {
+		enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+		state.blend = enabled;
+	}
+	// the function only matters while blending
+	if (enabled && change(state.blend_src != src || state.blend_dst != dst)) {
+		glBlendFunc(src, dst);
+		state.blend_src = src;
+		state.blend_dst = dst;
+	}
+}
+
+void GlStateCache::setDepthTest(bool enabled)
+{
+	if (change(state.depth_test != (int)enabled)) {
+		enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+		state.depth_test = enabled;
+	}
+}
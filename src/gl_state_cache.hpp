@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+
+#include "common.hpp"
+
+// Thin layer between the renderer and GL that remembers the bound objects and the
+// fixed function state, and drops calls that wouldn't change anything. Whoever calls
+// GL directly has to invalidate() the cache afterwards.
+class GlStateCache
+{
+public:
+	static const int TEXTURE_UNITS = 8;
+
+	struct Counters
+	{
+		unsigned int issued = 0;
+		unsigned int elided = 0;
+	};
+
+	// Forgets the state, the next call of every setter reaches GL
+	void invalidate();
+	// Starts counting the state changes of a new frame, also invalidates
+	void beginFrame();
+	const Counters& counters() const { return frame_counters; }
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	// GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER, the latter is state of the bound VAO
+	void bindBuffer(GLenum target, GLuint buffer);
+	void bindTexture(int unit, GLuint texture); // GL_TEXTURE_2D
+	void setBlend(bool enabled, GLenum src = GL_SRC_ALPHA, GLenum dst = GL_ONE_MINUS_SRC_ALPHA);
+	void setDepthTest(bool enabled);
+
+private:
+	// Counts the call and returns true if it has to reach GL
+	bool change(bool differs);
+
+	static const GLuint UNKNOWN = ~0u;
+	struct State
+	{
+		GLuint program = UNKNOWN;
+		GLuint vao = UNKNOWN;
+		GLuint array_buffer = UNKNOWN;
+		GLuint element_buffer = UNKNOWN;
+		GLuint active_unit = UNKNOWN;
+		std::array<GLuint, TEXTURE_UNITS> textures;
+		int blend = -1; // -1 unknown, 0 off, 1 on
+		GLenum blend_src = UNKNOWN;
+		GLenum blend_dst = UNKNOWN;
+		int depth_test = -1;
+
+		State() { textures.fill(UNKNOWN); }
+	};
+
+	State state;
+	Counters frame_counters;
+};
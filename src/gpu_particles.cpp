@@ -0,0 +1,130 @@
+// internal
+#include "gpu_particles.hpp"
+#include "render_system.hpp"
+
+// stlib
+#include <algorithm>
+#include <cassert>
+
+// Same behaviour as the ParticlePool
+const float GPU_PARTICLE_LIFE_MS = 1500.f;
+
+bool GpuParticles::init()
+{
+	const char* varyings[] = { "out_position", "out_velocity" };
+	if (!loadTransformFeedbackEffect(shader_path("particle_update") + ".vs.glsl", varyings, 2, update_program)) {
+		update_program = 0;
+		return false;
+	}
+	elapsed_ms_loc = glGetUniformLocation(update_program, "elapsed_ms");
+	life_ms_loc = glGetUniformLocation(update_program, "life_ms");
+	step_seed_loc = glGetUniformLocation(update_program, "step_seed");
+	burst_count_loc = glGetUniformLocation(update_program, "burst_count");
+	burst_range_loc = glGetUniformLocation(update_program, "burst_range");
+	burst_center_loc = glGetUniformLocation(update_program, "burst_center");
+	burst_seed_loc = glGetUniformLocation(update_program, "burst_seed");
+
+	// All particles start out dead, with a life of 0
+	std::vector<Particle> initial(CAPACITY, { vec4(0.f), vec2(0.f) });
+	GLint default_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &default_vao);
+	glGenBuffers(2, buffers);
+	glGenVertexArrays(2, vaos);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, CAPACITY * sizeof(Particle), initial.data(), GL_DYNAMIC_COPY);
+
+		// Layout of the update shader
+		glBindVertexArray(vaos[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Particle), (void*)sizeof(vec4));
+	}
+	glBindVertexArray((GLuint)default_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_has_errors();
+	return true;
+}
+
+void GpuParticles::destroy()
+{
+	if (!ready())
+		return;
+	glDeleteVertexArrays(2, vaos);
+	glDeleteBuffers(2, buffers);
+	glDeleteProgram(update_program);
+	update_program = 0;
+}
+
+void GpuParticles::emitBurst(vec2 center, unsigned int count, RandomStream& rng)
+{
+	assert(count <= CAPACITY);
+	if (cursor + count > CAPACITY)
+		cursor = 0;
+	pending.push_back({ cursor, count, center, rng.next() });
+	cursor += count;
+	high_water = std::max(high_water, cursor);
+	ms_since_last_burst = 0.f;
+}
+
+void GpuParticles::step(float elapsed_ms, RandomStream& rng)
+{
+	if (!ready())
+		return;
+
+	// Once every particle is dead nothing needs to be updated or drawn
+	ms_since_last_burst += elapsed_ms;
+	if (pending.empty() && ms_since_last_burst > GPU_PARTICLE_LIFE_MS) {
+		cursor = 0;
+		high_water = 0;
+	}
+	if (high_water == 0)
+		return;
+
+	spin += 0.5f;
+	if (spin >= 2 * M_PI)
+		spin = 0.f;
+
+	glUseProgram(update_program);
+	glUniform1f(elapsed_ms_loc, elapsed_ms);
+	glUniform1f(life_ms_loc, GPU_PARTICLE_LIFE_MS);
+	glUniform1ui(step_seed_loc, rng.next());
+
+	// Spawn up to MAX_BURSTS bursts in this pass, the others wait for the next step
+	int burst_count = (int)std::min(pending.size(), (size_t)MAX_BURSTS);
+	GLint ranges[2 * MAX_BURSTS];
+	GLfloat centers[2 * MAX_BURSTS];
+	GLuint seeds[MAX_BURSTS];
+	for (int b = 0; b < burst_count; b++) {
+		ranges[2 * b + 0] = (GLint)pending[b].first;
+		ranges[2 * b + 1] = (GLint)pending[b].count;
+		centers[2 * b + 0] = pending[b].center.x;
+		centers[2 * b + 1] = pending[b].center.y;
+		seeds[b] = pending[b].seed;
+	}
+	glUniform1i(burst_count_loc, burst_count);
+	if (burst_count > 0) {
+		glUniform2iv(burst_range_loc, burst_count, ranges);
+		glUniform2fv(burst_center_loc, burst_count, centers);
+		glUniform1uiv(burst_seed_loc, burst_count, seeds);
+	}
+	pending.erase(pending.begin(), pending.begin() + burst_count);
+	gl_has_errors();
+
+	// Read the current buffer, write the other one
+	glBindVertexArray(vaos[current]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffers[1 - current]);
+	gl_has_errors();
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, (GLsizei)high_water);
+	glEndTransformFeedback();
+	glDisable(GL_RASTERIZER_DISCARD);
+	gl_has_errors();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	current = 1 - current;
+	gl_has_errors();
+}
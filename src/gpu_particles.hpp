@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "random.hpp"
+
+// Death particles simulated on the GPU with transform feedback. The particle state
+// lives in two buffers, every step a vertex-only pass reads one and writes the other.
+// Bursts are spawned by that same pass from a few uniforms, so the CPU never touches
+// a particle. The buffer that was written last is drawn with particle.vs.glsl, its
+// x, y, 1, life come first in every particle and feed in_part_pos at location 4.
+class GpuParticles
+{
+public:
+	static const unsigned int CAPACITY = 1 << 18;
+
+	// Particle layout of the buffers, matches the varyings of particle_update.vs.glsl
+	struct Particle
+	{
+		vec4 position; // x, y, 1, life
+		vec2 velocity;
+	};
+
+	// Loads the update shader and allocates the buffers, needs a current GL context.
+	// Returns false if transform feedback isn't usable.
+	bool init();
+	void destroy();
+	bool ready() const { return update_program != 0; }
+
+	// Queues a burst of 'count' particles around 'center', spawned by the next step
+	void emitBurst(vec2 center, unsigned int count, RandomStream& rng);
+
+	// Runs the update pass, the GL context has to be current
+	void step(float elapsed_ms, RandomStream& rng);
+
+	// The buffer to draw from and the number of instances in it, dead particles are
+	// skipped by the vertex shader
+	GLuint buffer() const { return buffers[current]; }
+	unsigned int count() const { return high_water; }
+	float angle() const { return spin; }
+
+private:
+	// Must match MAX_BURSTS in particle_update.vs.glsl
+	static const int MAX_BURSTS = 4;
+
+	struct Burst
+	{
+		unsigned int first, count;
+		vec2 center;
+		uint32_t seed;
+	};
+
+	GLuint update_program = 0;
+	GLint elapsed_ms_loc = -1, life_ms_loc = -1, step_seed_loc = -1;
+	GLint burst_count_loc = -1, burst_range_loc = -1, burst_center_loc = -1, burst_seed_loc = -1;
+	GLuint buffers[2] = { 0, 0 };
+	// vaos[i] reads the particles of buffers[i]
+	GLuint vaos[2] = { 0, 0 };
+	int current = 0;
+
+	// Bursts are placed one after the other and wrap around, overwriting the oldest.
+	// Only particles below the high water mark are updated and drawn.
+	unsigned int cursor = 0;
+	unsigned int high_water = 0;
+	float ms_since_last_burst = 0.f;
+	float spin = 0.f;
+	std::vector<Burst> pending;
+};
@@ -0,0 +1,178 @@
+// internal
+#include "headless.hpp"
+#include "despawn_system.hpp"
+#include "entity_pool.hpp"
+#include "physics_system.hpp"
+#include "random.hpp"
+#include "spatial_index.hpp"
+#include "tiny_ecs_registry.hpp"
+#include "world_init.hpp"
+
+// stlib
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using Clock = std::chrono::high_resolution_clock;
+
+// The tick and window height of the game
+const float HEADLESS_TICK_MS = 1000.f / 60.f;
+const float HEADLESS_WINDOW_WIDTH_PX = 1200.f;
+const float HEADLESS_WINDOW_HEIGHT_PX = 800.f;
+
+// Piles don't touch each other even after they spread out on the floor, pebbles
+// roll up to about 360 px away from the centre of their pile
+const float PILE_SPACING_PX = 1000.f;
+const unsigned int PEBBLES_PER_PILE = 12;
+// The pebbles fall, stack and most of them fall asleep in this time
+const unsigned int PILE_BENCHMARK_TICKS = 240;
+const unsigned int MAX_BENCHMARK_THREADS = 16;
+const uint64_t PILE_SEED = 2024;
+
+// WorldSystem throws a pebble every 133 to 267 ms of game time, at the fastest game
+// speed that is 3 times as often
+const float PEBBLE_MIN_DELAY_MS = 2000.f / 15;
+const float FASTEST_GAME_SPEED = 3.f;
+const float COUNT_LOG_INTERVAL_MS = 10000.f;
+const uint64_t WORLD_SEED = 7;
+
+namespace {
+	// FNV-1a over the bits of all motions, equal hashes mean bit-identical runs
+	uint64_t hashMotions()
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (const Motion& motion : registry.motions.components) {
+			const float values[] = { motion.position.x, motion.position.y, motion.velocity.x, motion.velocity.y };
+			unsigned char bytes[sizeof(values)];
+			memcpy(bytes, values, sizeof(values));
+			for (unsigned char byte : bytes)
+				hash = (hash ^ byte) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void despawnAll()
+	{
+		// From the back, so that the pools hand out the same ids in the same order again
+		while (registry.motions.size() > 0)
+			entity_pools.despawn(registry.motions.entities.back());
+		for (int i = 0; i < EntityPools::QUARANTINE_STEPS; i++)
+			entity_pools.endStep();
+		registry.collisions.clear();
+		spatial_index.clear();
+	}
+
+	// Simulates the piles from scratch, returns the hash of the final motions
+	uint64_t simulatePiles(unsigned int pile_count, unsigned int thread_count, double& out_ms_per_tick)
+	{
+		// Columns of pebbles that collapse into piles, the same ones every run
+		RandomStream rng(PILE_SEED, 0);
+		for (unsigned int pile = 0; pile < pile_count; pile++) {
+			for (unsigned int i = 0; i < PEBBLES_PER_PILE; i++) {
+				float radius = 30 * (rng.uniform() + 0.3f); // as spawned by the game
+				vec2 position = { (pile + 0.5f) * PILE_SPACING_PX + rng.uniform(-20.f, 20.f), HEADLESS_WINDOW_HEIGHT_PX - 30.f - 60.f * i };
+				Entity pebble = createPebble(position, { radius, radius });
+				registry.physics.get(pebble).mass *= 0.1f * radius;
+			}
+		}
+
+		PhysicsSystem physics;
+		physics.setThreadCount(thread_count);
+		const float world_width = pile_count * PILE_SPACING_PX;
+		auto start = Clock::now();
+		for (unsigned int tick = 0; tick < PILE_BENCHMARK_TICKS; tick++) {
+			physics.step(HEADLESS_TICK_MS, world_width, HEADLESS_WINDOW_HEIGHT_PX);
+			// WorldSystem::handle_collisions does this in the game
+			registry.collisions.clear();
+		}
+		out_ms_per_tick = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / PILE_BENCHMARK_TICKS;
+
+		uint64_t hash = hashMotions();
+		despawnAll();
+		return hash;
+	}
+}
+
+int runPileBenchmark(unsigned int pile_count)
+{
+	printf("%u piles of %u pebbles, %u ticks\n", pile_count, PEBBLES_PER_PILE, PILE_BENCHMARK_TICKS);
+
+	double single_ms = 0.0;
+	const uint64_t reference = simulatePiles(pile_count, 1, single_ms);
+	const bool deterministic = simulatePiles(pile_count, 1, single_ms) == reference;
+	printf("single threaded runs are %s\n", deterministic ? "bit-identical" : "DIFFERENT");
+
+	unsigned int first = 1, last = MAX_BENCHMARK_THREADS;
+	const char* threads_env = getenv("SALMON_THREADS");
+	if (threads_env)
+		first = last = std::max(1u, (unsigned int)strtoul(threads_env, nullptr, 10));
+
+	bool thread_independent = true;
+	for (unsigned int thread_count = first; thread_count <= last; thread_count++) {
+		double ms = 0.0;
+		const bool same = simulatePiles(pile_count, thread_count, ms) == reference;
+		thread_independent = thread_independent && same;
+		printf("%2u threads %9.3f ms/tick, speedup %5.2f, %s single threaded result\n",
+			thread_count, ms, single_ms / ms, same ? "same as" : "DIFFERENT from");
+	}
+	return deterministic && thread_independent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int runHeadlessWorld(float simulated_seconds)
+{
+	// Pebbles are the only entities the game spawns without a cap, nothing but their
+	// lifetime and the despawn volumes keep their number from growing
+	const size_t pebble_bound = (size_t)ceilf(PEBBLE_LIFETIME_MS / (PEBBLE_MIN_DELAY_MS / FASTEST_GAME_SPEED)) + 1;
+	printf("%.0f simulated seconds, at most %zu pebbles alive at a time\n", simulated_seconds, pebble_bound);
+
+	PhysicsSystem physics;
+	DespawnSystem despawns;
+	RandomStream rng(WORLD_SEED, 0);
+	// The salmon throws the pebbles, this one stays in the middle of the screen
+	const vec2 emitter = { HEADLESS_WINDOW_WIDTH_PX / 2, HEADLESS_WINDOW_HEIGHT_PX / 2 };
+	const vec2 screen_size = { HEADLESS_WINDOW_WIDTH_PX, HEADLESS_WINDOW_HEIGHT_PX };
+
+	float next_pebble_spawn = 0.f;
+	float next_log = 0.f;
+	size_t peak = 0;
+	const unsigned int ticks = (unsigned int)(simulated_seconds * 1000.f / HEADLESS_TICK_MS);
+	for (unsigned int tick = 0; tick <= ticks; tick++) {
+		// The order of WorldSystem::step, then the physics of main's loop
+		entity_pools.endStep();
+		despawns.step(HEADLESS_TICK_MS, screen_size);
+
+		// Same as WorldSystem::step, at the fastest game speed
+		next_pebble_spawn -= HEADLESS_TICK_MS * FASTEST_GAME_SPEED;
+		if (next_pebble_spawn < 0.f) {
+			next_pebble_spawn = PEBBLE_MIN_DELAY_MS + rng.uniform() * PEBBLE_MIN_DELAY_MS;
+			float radius = 30 * (rng.uniform() + 0.3f);
+			Entity pebble = createPebble(emitter, { radius, radius });
+			registry.physics.get(pebble).mass *= 0.1f * radius;
+			int randNum1 = rng.uniformInt(150, 200);
+			int randNum2 = rng.uniformInt(120, 170);
+			vec2 velocity = { (float)randNum1, (float)randNum2 };
+			if (randNum1 % 2 == 0)
+				velocity.x *= -1.f;
+			if (randNum2 % 3 == 0)
+				velocity.y *= -1.f;
+			registry.motions.get(pebble).velocity = velocity;
+		}
+
+		physics.step(HEADLESS_TICK_MS, HEADLESS_WINDOW_WIDTH_PX, HEADLESS_WINDOW_HEIGHT_PX);
+		registry.collisions.clear();
+
+		peak = std::max(peak, registry.motions.size());
+		const float now_ms = tick * HEADLESS_TICK_MS;
+		if (now_ms >= next_log) {
+			printf("%6.0f s %5zu motions, peak %5zu, %5zu pebble ids reusable\n",
+				now_ms / 1000.f, registry.motions.size(), peak, entity_pools.reusable(ARCHETYPE_ID::PEBBLE));
+			next_log += COUNT_LOG_INTERVAL_MS;
+		}
+	}
+
+	despawnAll();
+	printf("peak of %zu motions is %s\n", peak, peak <= pebble_bound ? "within the bound" : "ABOVE the bound");
+	return peak <= pebble_bound ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Measurements of the simulation that run without a window or GL context. main starts
+// them with a command line flag instead of the game.
+
+// Drops pebbles into 'pile_count' piles far enough apart that each is an island of its
+// own and times PhysicsSystem::step with 1 to 16 threads, or only with SALMON_THREADS
+// threads if that is set. Two single threaded runs must end bit-identical. Returns the
+// exit code.
+int runPileBenchmark(unsigned int pile_count = 200);
+
+// Throws pebbles the way the game does at its fastest speed for 'simulated_seconds' and
+// steps the physics and the despawns. Logs the number of motions every 10 simulated
+// seconds and fails if it ever exceeds what the pebble lifetime allows.
+int runHeadlessWorld(float simulated_seconds = 600.f);
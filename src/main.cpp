@@ -4,13 +4,20 @@
 
 // stlib
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
 #include <thread>
 #include <iostream>
 
 // internal
 #include "ai_system.hpp"
+#include "headless.hpp"
 #include "physics_system.hpp"
+#include "random.hpp"
 #include "render_system.hpp"
+#include "spatial_sort_system.hpp"
 #include "world_system.hpp"
 
 using Clock = std::chrono::high_resolution_clock;
@@ -18,19 +25,31 @@ using Clock = std::chrono::high_resolution_clock;
 const int window_width_px = 1200;
 const int window_height_px = 800;
 
+// The simulation advances in fixed ticks, independent of the display rate
+const float SIMULATION_HZ = 60.f;
+// A slow frame runs at most this many ticks, the remaining time is dropped
+const int MAX_SUBSTEPS = 5;
+
 //void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 //{
 //	glViewport(0, 0, width, height);
 //}
 
 // Entry point
-int main()
+int main(int argc, char* argv[])
 {
+	// Measurements without a window, see headless.hpp
+	if (argc > 1 && strcmp(argv[1], "--bench-piles") == 0)
+		return argc > 2 ? runPileBenchmark((unsigned int)strtoul(argv[2], nullptr, 10)) : runPileBenchmark();
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+		return argc > 2 ? runHeadlessWorld(strtof(argv[2], nullptr)) : runHeadlessWorld();
+
 	// Global systems
 	WorldSystem world;
 	RenderSystem renderer;
 	PhysicsSystem physics;
 	AISystem ai;
+	SpatialSortSystem spatial_sort;
 	ai.frameCounter = 5;
 
 	// Initializing window
@@ -43,11 +62,25 @@ int main()
 	}
 	// glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
+	// Set SALMON_SEED to replay a run, the seed is printed either way
+	const char* seed_env = getenv("SALMON_SEED");
+	uint64_t seed = seed_env ? strtoull(seed_env, nullptr, 10) : ((uint64_t)std::random_device()() << 32) | std::random_device()();
+	random_service.seed(seed);
+	printf("Random seed %llu\n", (unsigned long long)seed);
+
+	// Set SALMON_THREADS to the number of physics threads, all hardware threads by default
+	const char* threads_env = getenv("SALMON_THREADS");
+	if (threads_env)
+		physics.setThreadCount((unsigned int)strtoul(threads_env, nullptr, 10));
+	printf("Physics threads %u\n", physics.threadCount());
+
 	// initialize the main systems
 	renderer.init(window_width_px, window_height_px, window);
-	world.init(&renderer);
+	world.init(&renderer, &physics.workerPool());
 
-	// variable timestep loop
+	// fixed timestep loop, the renderer interpolates between the last two ticks
+	const float tick_ms = 1000.f / SIMULATION_HZ;
+	float accumulator_ms = 0.f;
 	auto t = Clock::now();
 	while (!world.is_over()) {
 		// Processes system messages, if this wasn't present the window would become
@@ -59,20 +92,31 @@ int main()
 		float elapsed_ms =
 			(float)(std::chrono::duration_cast<std::chrono::microseconds>(now - t)).count() / 1000;
 		t = now;
-		
-		world.step(elapsed_ms);
-		if (ai.internalFrameCounter == 100) {
-			ai.internalFrameCounter = 0;
-		}
-		else {
-			ai.internalFrameCounter++;
+		accumulator_ms += elapsed_ms;
+
+		int substeps = 0;
+		while (accumulator_ms >= tick_ms && substeps < MAX_SUBSTEPS) {
+			world.step(tick_ms);
+			if (ai.internalFrameCounter == 100) {
+				ai.internalFrameCounter = 0;
+			}
+			else {
+				ai.internalFrameCounter++;
+
+			}
+			ai.step(tick_ms);
+			physics.step(tick_ms, window_width_px, window_height_px);
+			world.handle_collisions();
+			spatial_sort.step();
 
+			accumulator_ms -= tick_ms;
+			substeps++;
 		}
-		ai.step(elapsed_ms);
-		physics.step(elapsed_ms, window_width_px, window_height_px);
-		world.handle_collisions();
+		// Don't try to catch up after a long stall, that would only make the next frame slower
+		if (substeps == MAX_SUBSTEPS)
+			accumulator_ms = fmodf(accumulator_ms, tick_ms);
 
-		renderer.draw();
+		renderer.draw(accumulator_ms / tick_ms);
 
 		// TODO A2: you can implement the debug freeze here but other places are possible too.
 		if (debugging.in_freeze_mode && debugging.in_debug_mode) {
@@ -0,0 +1,195 @@
+// internal
+#include "particle_pool.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// stlib
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_POOL_SSE2 1
+#endif
+
+ParticlePool particle_pool;
+
+// Particle behaviour
+const float PARTICLE_LIFE_MS = 1500.f;
+const float PARTICLE_FADE_PER_STEP = 0.05f * 0.01f;
+const float PARTICLE_JITTER_STEPS = 17.f; // the velocity is scaled by 0..16 steps
+const float PARTICLE_JITTER_SCALE = 0.3f;
+// An emitter is removed once all but this many of its particles have faded
+const unsigned int PARTICLE_STRAGGLERS = 5;
+// Pools with fewer particles are updated on the calling thread
+const unsigned int PARALLEL_PARTICLES = 2048;
+
+static_assert(WorkerPool::MAX_THREADS <= RandomService::MAX_WORKER_STREAMS, "Every worker needs a random stream");
+
+ParticlePool::ParticlePool()
+{
+	// Everything is allocated up front, spawning a burst never allocates
+	position_x.resize(CAPACITY);
+	position_y.resize(CAPACITY);
+	velocity_x.resize(CAPACITY);
+	velocity_y.resize(CAPACITY);
+	color.resize(CAPACITY);
+	alpha.resize(CAPACITY);
+	life.resize(CAPACITY);
+	instance_data.resize(CAPACITY);
+	noise.resize(2 * CAPACITY);
+}
+
+bool ParticlePool::emitBurst(Entity entity, vec2 center, unsigned int count, RandomStream& rng)
+{
+	assert(count <= MAX_EMITTER_PARTICLES);
+	if (registry.particleEmitters.has(entity))
+		return false;
+	compact();
+	if (used + count > CAPACITY)
+		return false;
+
+	ParticleEmitter& emitter = registry.particleEmitters.emplace(entity);
+	emitter.first = used;
+	emitter.count = count;
+	for (unsigned int i = used; i < used + count; i++) {
+		velocity_x[i] = (rng.uniformInt(0, 49) - 10) * 5 * 0.1f;
+		velocity_y[i] = (rng.uniformInt(0, 49) - 10) * 5 * 0.1f;
+		position_x[i] = center.x + (rng.uniformInt(0, 99) - 50) / 10.0f + 20.f;
+		position_y[i] = center.y + (rng.uniformInt(0, 199) - 100) / 10.0f + 40.f;
+		float brightness = 0.5f + (rng.uniformInt(0, 99) / 100.0f);
+		color[i] = vec3(brightness);
+		alpha[i] = 1.f;
+		life[i] = PARTICLE_LIFE_MS;
+		instance_data[i] = vec4(position_x[i], position_y[i], 1.f, life[i]);
+	}
+	used += count;
+	return true;
+}
+
+void ParticlePool::move(unsigned int from, unsigned int to, unsigned int count)
+{
+	// Ranges only move towards the start, copying forward is safe
+	assert(to < from);
+	std::copy(position_x.begin() + from, position_x.begin() + from + count, position_x.begin() + to);
+	std::copy(position_y.begin() + from, position_y.begin() + from + count, position_y.begin() + to);
+	std::copy(velocity_x.begin() + from, velocity_x.begin() + from + count, velocity_x.begin() + to);
+	std::copy(velocity_y.begin() + from, velocity_y.begin() + from + count, velocity_y.begin() + to);
+	std::copy(color.begin() + from, color.begin() + from + count, color.begin() + to);
+	std::copy(alpha.begin() + from, alpha.begin() + from + count, alpha.begin() + to);
+	std::copy(life.begin() + from, life.begin() + from + count, life.begin() + to);
+	std::copy(instance_data.begin() + from, instance_data.begin() + from + count, instance_data.begin() + to);
+}
+
+void ParticlePool::compact()
+{
+	// Emitters of removed entities are gone from the registry, their ranges are dropped.
+	// The container reorders on removal, so walk the emitters by their range.
+	emitters_by_range.clear();
+	for (ParticleEmitter& emitter : registry.particleEmitters.components)
+		emitters_by_range.push_back(&emitter);
+	std::sort(emitters_by_range.begin(), emitters_by_range.end(),
+		[](const ParticleEmitter* a, const ParticleEmitter* b) { return a->first < b->first; });
+
+	unsigned int end = 0;
+	for (ParticleEmitter* emitter : emitters_by_range) {
+		if (emitter->first != end) {
+			move(emitter->first, end, emitter->count);
+			emitter->first = end;
+		}
+		end += emitter->count;
+	}
+	used = end;
+}
+
+void ParticlePool::update(unsigned int begin, unsigned int end, float elapsed_ms, RandomStream& rng)
+{
+	// The slice's noise goes to [2 * begin, 2 * end) of the buffer, x then y, the pointers
+	// are offset so that they are indexed by particle
+	const unsigned int count = end - begin;
+	float* slice_noise = noise.data() + 2 * begin;
+	rng.fillUniform(slice_noise, 2 * count);
+	const float* jitter_x = slice_noise - begin;
+	const float* jitter_y = slice_noise + count - begin;
+
+	float* px = position_x.data();
+	float* py = position_y.data();
+	const float* vx = velocity_x.data();
+	const float* vy = velocity_y.data();
+	float* a = alpha.data();
+	float* l = life.data();
+	float* out = (float*)instance_data.data();
+
+	// The particles drift across their velocity, as they always have
+	unsigned int i = begin;
+#if defined(PARTICLE_POOL_SSE2)
+	const __m128 elapsed = _mm_set1_ps(elapsed_ms);
+	const __m128 steps = _mm_set1_ps(PARTICLE_JITTER_STEPS);
+	const __m128 scale = _mm_set1_ps(PARTICLE_JITTER_SCALE);
+	const __m128 fade = _mm_set1_ps(PARTICLE_FADE_PER_STEP);
+	const __m128 one = _mm_set1_ps(1.f);
+	for (; i + 4 <= end; i += 4)
+	{
+		// the noise is in [0, 1), truncating is the same as floor
+		__m128 jx = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(jitter_x + i), steps)));
+		__m128 jy = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(jitter_y + i), steps)));
+		__m128 x = _mm_sub_ps(_mm_loadu_ps(px + i), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(vy + i), jx), scale));
+		__m128 y = _mm_sub_ps(_mm_loadu_ps(py + i), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(vx + i), jy), scale));
+		__m128 remaining = _mm_sub_ps(_mm_loadu_ps(l + i), elapsed);
+		_mm_storeu_ps(px + i, x);
+		_mm_storeu_ps(py + i, y);
+		_mm_storeu_ps(l + i, remaining);
+		_mm_storeu_ps(a + i, _mm_sub_ps(_mm_loadu_ps(a + i), fade));
+
+		// Four rows of x, y, 1, life
+		__m128 w = one;
+		_MM_TRANSPOSE4_PS(x, y, w, remaining);
+		_mm_storeu_ps(out + 4 * i + 0, x);
+		_mm_storeu_ps(out + 4 * i + 4, y);
+		_mm_storeu_ps(out + 4 * i + 8, w);
+		_mm_storeu_ps(out + 4 * i + 12, remaining);
+	}
+#endif
+	// Scalar fallback and the remaining particles
+	for (; i < end; i++)
+	{
+		px[i] -= vy[i] * (float)(int)(jitter_x[i] * PARTICLE_JITTER_STEPS) * PARTICLE_JITTER_SCALE;
+		py[i] -= vx[i] * (float)(int)(jitter_y[i] * PARTICLE_JITTER_STEPS) * PARTICLE_JITTER_SCALE;
+		l[i] -= elapsed_ms;
+		a[i] -= PARTICLE_FADE_PER_STEP;
+		instance_data[i] = vec4(px[i], py[i], 1.f, l[i]);
+	}
+}
+
+void ParticlePool::step(float elapsed_ms, WorkerPool& workers)
+{
+	compact();
+	if (used == 0)
+		return;
+
+	// Small pools aren't worth waking the workers, they run as worker 0
+	if (used < PARALLEL_PARTICLES)
+		update(0, used, elapsed_ms, random_service.workerStream(0));
+	else
+		workers.forEachWorker([&](unsigned int worker, unsigned int worker_count) {
+			// The slices only depend on the thread count, a seeded run replays the same way.
+			// They start at multiples of 4 for the SSE2 loop.
+			unsigned int begin = (unsigned int)((uint64_t)used * worker / worker_count) & ~3u;
+			unsigned int end = worker + 1 == worker_count ? used : (unsigned int)((uint64_t)used * (worker + 1) / worker_count) & ~3u;
+			update(begin, end, elapsed_ms, random_service.workerStream(worker));
+		});
+
+	float* l = life.data();
+	// Spin the emitters and remove the ones that have faded
+	for (int e = (int)registry.particleEmitters.size() - 1; e >= 0; e--) {
+		ParticleEmitter& emitter = registry.particleEmitters.components[e];
+		emitter.angle += 0.5f;
+		if (emitter.angle >= 2 * M_PI)
+			emitter.angle = 0.f;
+
+		unsigned int faded = 0;
+		for (unsigned int p = emitter.first; p < emitter.first + emitter.count; p++)
+			faded += l[p] <= 0.f;
+		if (faded + PARTICLE_STRAGGLERS >= emitter.count)
+			registry.particleEmitters.remove(registry.particleEmitters.entities[e]);
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "components.hpp"
+#include "random.hpp"
+#include "tiny_ecs.hpp"
+#include "worker_pool.hpp"
+
+// Fixed capacity structure of arrays storage of all particles. Each ParticleEmitter
+// component owns a contiguous range of the pool, the ranges are packed at the start
+// so the update runs over one dense block, 4 particles at a time with SSE2. Large pools
+// are split into one slice per worker. The update also writes the per instance data of
+// the particle shader, which the renderer uploads as is.
+class ParticlePool
+{
+public:
+	static const unsigned int CAPACITY = 4096;
+	// Most particles of a single emitter, the size of the renderer's instance buffer
+	static const unsigned int MAX_EMITTER_PARTICLES = 1000;
+
+	ParticlePool();
+
+	// Spawns a burst of 'count' particles around 'center' as the ParticleEmitter of the
+	// entity. Returns false if the entity has one already or the pool is full.
+	bool emitBurst(Entity entity, vec2 center, unsigned int count, RandomStream& rng);
+
+	// Moves the particles and removes the emitters whose particles have faded. The random
+	// jitter comes from the worker streams of the random_service.
+	void step(float elapsed_ms, WorkerPool& workers);
+
+	// x, y, 1, life of each particle of the emitter, layout 4 of the particle shader
+	const vec4* instances(const ParticleEmitter& emitter) const { return instance_data.data() + emitter.first; }
+
+	unsigned int size() const { return used; }
+
+private:
+	// Closes the gaps left by removed emitters
+	void compact();
+	void move(unsigned int from, unsigned int to, unsigned int count);
+	// Moves the particles in [begin, end)
+	void update(unsigned int begin, unsigned int end, float elapsed_ms, RandomStream& rng);
+
+	unsigned int used = 0;
+	std::vector<float> position_x;
+	std::vector<float> position_y;
+	std::vector<float> velocity_x;
+	std::vector<float> velocity_y;
+	std::vector<vec3> color;
+	std::vector<float> alpha;
+	std::vector<float> life;
+	std::vector<vec4> instance_data;
+	// Two random numbers per particle and step, generated in one batch per slice
+	std::vector<float> noise;
+	std::vector<ParticleEmitter*> emitters_by_range;
+};
+
+extern ParticlePool particle_pool;
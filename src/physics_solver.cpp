@@ -0,0 +1,309 @@
+// internal
+#include "physics_solver.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+
+// Solver configuration
+const int SOLVER_ITERATIONS = 8;
+const float BAUMGARTE = 0.2f;              // fraction of the penetration removed per step
+const float PENETRATION_SLOP = 0.5f;       // pixels of overlap that are tolerated to avoid jitter
+const float RESTITUTION = 0.3f;
+const float RESTITUTION_THRESHOLD = 40.f;  // pixels per second, slower impacts don't bounce
+const float FRICTION = 0.4f;
+const float SLEEP_SPEED = 8.f;             // pixels per second
+const float SLEEP_TIME_MS = 500.f;         // how long a body has to be slow before it sleeps
+const float WAKE_SPEED = 30.f;             // pixels per second, gentler touches keep sleepers asleep
+
+void ContactSolver::begin(size_t body_count)
+{
+	bodies.assign(body_count, Body());
+	contacts.clear();
+}
+
+void ContactSolver::addBody(unsigned int index, Entity& entity, Motion& motion, Physics& physics)
+{
+	Body& body = bodies[index];
+	body.entity = &entity;
+	body.motion = &motion;
+	body.physics = &physics;
+	// sleeping bodies act as static until something wakes them up
+	body.inv_mass = (physics.mass > 0.f && !physics.asleep) ? 1.f / physics.mass : 0.f;
+	body.radius = 0.5f * std::max(fabsf(motion.scale.x), fabsf(motion.scale.y));
+}
+
+void ContactSolver::wake(Body& body)
+{
+	body.physics->asleep = false;
+	body.physics->sleep_timer_ms = 0.f;
+	body.inv_mass = body.physics->mass > 0.f ? 1.f / body.physics->mass : 0.f;
+}
+
+void ContactSolver::addContact(unsigned int index_a, unsigned int index_b, CachedContact& cached)
+{
+	// Keep the body order of the cache, so the stored impulses have a consistent sign
+	if ((unsigned int)*bodies[index_a].entity != (unsigned int)cached.a)
+		std::swap(index_a, index_b);
+	Body& a = bodies[index_a];
+	Body& b = bodies[index_b];
+	assert(a.motion && b.motion);
+
+	Contact contact;
+	contact.a = index_a;
+	contact.b = index_b;
+	contact.cached = &cached;
+
+	vec2 d = b.motion->position - a.motion->position;
+	float dist_squared = dot(d, d);
+	float radii = a.radius + b.radius;
+	if (dist_squared >= radii * radii) {
+		// the bounding circles touch but the bodies don't, nothing to warm start from.
+		// The pair is still kept to track whether it is sleeping.
+		cached.normal_impulse = 0.f;
+		cached.tangent_impulse = 0.f;
+		contact.touching = false;
+		contacts.push_back(contact);
+		return;
+	}
+
+	float dist = sqrtf(dist_squared);
+	vec2 normal = dist > 1e-4f ? d / dist : vec2(0.f, 1.f);
+
+	// A sleeping body is only woken by a hit that is faster than a gentle touch
+	if (a.physics->asleep != b.physics->asleep) {
+		float approach = dot(a.motion->velocity - b.motion->velocity, normal);
+		if (approach > WAKE_SPEED)
+			wake(a.physics->asleep ? a : b);
+	}
+
+	contact.normal = normal;
+	contact.separation = dist - radii;
+	contact.touching = true;
+	contacts.push_back(contact);
+
+	cached.normal = normal;
+	cached.point = a.motion->position + normal * (a.radius + 0.5f * contact.separation);
+}
+
+void ContactSolver::addFloorContacts(float floor_y, ContactCache& cache)
+{
+	for (unsigned int i = 0; i < bodies.size(); i++) {
+		Body& body = bodies[i];
+		if (!body.motion || body.physics->asleep || !body.physics->affectedByGravity)
+			continue;
+		float separation = floor_y - (body.motion->position.y + body.radius);
+		if (separation >= 0.f)
+			continue;
+
+		Contact contact;
+		contact.a = i;
+		contact.b = FLOOR;
+		contact.normal = { 0.f, 1.f };
+		contact.separation = separation;
+		contact.touching = true;
+		contact.cached = &cache.touchFloor(*body.entity);
+		contacts.push_back(contact);
+
+		contact.cached->normal = contact.normal;
+		contact.cached->point = { body.motion->position.x, floor_y };
+	}
+}
+
+vec2 ContactSolver::velocityOf(unsigned int index) const
+{
+	return index == FLOOR ? vec2(0.f) : bodies[index].motion->velocity;
+}
+
+float ContactSolver::invMassOf(unsigned int index) const
+{
+	return index == FLOOR ? 0.f : bodies[index].inv_mass;
+}
+
+void ContactSolver::applyImpulse(const Contact& contact, vec2 impulse)
+{
+	// Static and sleeping bodies can be shared by islands, they are only read
+	Body& a = bodies[contact.a];
+	if (a.inv_mass > 0.f)
+		a.motion->velocity -= impulse * a.inv_mass;
+	if (contact.b != FLOOR) {
+		Body& b = bodies[contact.b];
+		if (b.inv_mass > 0.f)
+			b.motion->velocity += impulse * b.inv_mass;
+	}
+}
+
+unsigned int ContactSolver::findRoot(unsigned int index)
+{
+	while (island_parent[index] != index) {
+		island_parent[index] = island_parent[island_parent[index]];
+		index = island_parent[index];
+	}
+	return index;
+}
+
+void ContactSolver::buildIslands()
+{
+	const unsigned int body_count = (unsigned int)bodies.size();
+	island_parent.resize(body_count);
+	for (unsigned int i = 0; i < body_count; i++)
+		island_parent[i] = i;
+
+	// Only moving bodies connect, a pile on a sleeping body is not joined with the
+	// other piles on it. The smaller index becomes the root to keep the order stable.
+	for (const Contact& contact : contacts) {
+		if (!contact.touching || contact.b == FLOOR)
+			continue;
+		if (bodies[contact.a].inv_mass == 0.f || bodies[contact.b].inv_mass == 0.f)
+			continue;
+		unsigned int root_a = findRoot(contact.a);
+		unsigned int root_b = findRoot(contact.b);
+		if (root_a < root_b)
+			island_parent[root_b] = root_a;
+		else if (root_b < root_a)
+			island_parent[root_a] = root_b;
+	}
+
+	// Number the islands by their root, in body order
+	const unsigned int NO_ISLAND = ~0u;
+	std::vector<unsigned int> island_of(body_count, NO_ISLAND);
+	islands.clear();
+	for (unsigned int i = 0; i < body_count; i++) {
+		if (bodies[i].inv_mass == 0.f)
+			continue;
+		unsigned int root = findRoot(i);
+		if (island_of[root] == NO_ISLAND) {
+			island_of[root] = (unsigned int)islands.size();
+			islands.push_back({ 0, 0, 0, 0 });
+		}
+		island_of[i] = island_of[root];
+		islands[island_of[i]].body_count++;
+	}
+
+	// A contact goes to the island of its moving body, contacts without one do nothing
+	std::vector<unsigned int> contact_island(contacts.size(), NO_ISLAND);
+	for (unsigned int c = 0; c < contacts.size(); c++) {
+		const Contact& contact = contacts[c];
+		if (!contact.touching)
+			continue;
+		if (bodies[contact.a].inv_mass > 0.f)
+			contact_island[c] = island_of[contact.a];
+		else if (contact.b != FLOOR && bodies[contact.b].inv_mass > 0.f)
+			contact_island[c] = island_of[contact.b];
+		if (contact_island[c] != NO_ISLAND)
+			islands[contact_island[c]].contact_count++;
+	}
+
+	// Counting sort, the bodies and contacts keep their order within an island
+	unsigned int body_offset = 0, contact_offset = 0;
+	for (Island& island : islands) {
+		island.first_body = body_offset;
+		island.first_contact = contact_offset;
+		body_offset += island.body_count;
+		contact_offset += island.contact_count;
+		island.body_count = 0;
+		island.contact_count = 0;
+	}
+	island_bodies.resize(body_offset);
+	island_contacts.resize(contact_offset);
+	for (unsigned int i = 0; i < body_count; i++) {
+		if (island_of[i] == NO_ISLAND)
+			continue;
+		Island& island = islands[island_of[i]];
+		island_bodies[island.first_body + island.body_count++] = i;
+	}
+	for (unsigned int c = 0; c < contacts.size(); c++) {
+		if (contact_island[c] == NO_ISLAND)
+			continue;
+		Island& island = islands[contact_island[c]];
+		island_contacts[island.first_contact + island.contact_count++] = c;
+	}
+}
+
+void ContactSolver::solve(float elapsed_ms, WorkerPool& workers)
+{
+	const float step_seconds = elapsed_ms / 1000.f;
+	if (step_seconds <= 0.f)
+		return;
+
+	buildIslands();
+	workers.parallelFor(islands.size(), 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			solveIsland(islands[i], step_seconds);
+	});
+
+	// Put bodies to sleep that have been slow for a while
+	for (Body& body : bodies) {
+		if (!body.motion || body.physics->asleep)
+			continue;
+		if (dot(body.motion->velocity, body.motion->velocity) > SLEEP_SPEED * SLEEP_SPEED) {
+			body.physics->sleep_timer_ms = 0.f;
+			continue;
+		}
+		body.physics->sleep_timer_ms += elapsed_ms;
+		if (body.physics->sleep_timer_ms > SLEEP_TIME_MS) {
+			body.physics->asleep = true;
+			body.motion->velocity = { 0.f, 0.f };
+		}
+	}
+
+	// Resting pairs stay in the contact cache without being tested again
+	for (const Contact& contact : contacts)
+		contact.cached->sleeping = bodies[contact.a].physics->asleep &&
+			(contact.b == FLOOR || bodies[contact.b].physics->asleep);
+}
+
+void ContactSolver::solveIsland(const Island& island, float step_seconds)
+{
+	const unsigned int* first = island_contacts.data() + island.first_contact;
+	const unsigned int* last = first + island.contact_count;
+
+	// Prepare the contacts and apply last step's impulses as the initial guess
+	for (const unsigned int* c = first; c != last; c++) {
+		Contact& contact = contacts[*c];
+		float inv_mass_sum = invMassOf(contact.a) + invMassOf(contact.b);
+		contact.normal_mass = inv_mass_sum > 0.f ? 1.f / inv_mass_sum : 0.f;
+
+		float approach_speed = dot(velocityOf(contact.b) - velocityOf(contact.a), contact.normal);
+		float position_bias = -BAUMGARTE / step_seconds * std::min(0.f, contact.separation + PENETRATION_SLOP);
+		float bounce_bias = approach_speed < -RESTITUTION_THRESHOLD ? -RESTITUTION * approach_speed : 0.f;
+		contact.bias = std::max(position_bias, bounce_bias);
+
+		contact.normal_impulse = contact.cached->normal_impulse;
+		contact.tangent_impulse = contact.cached->tangent_impulse;
+		vec2 tangent = { -contact.normal.y, contact.normal.x };
+		applyImpulse(contact, contact.normal_impulse * contact.normal + contact.tangent_impulse * tangent);
+	}
+
+	// Sequential impulses
+	for (int iteration = 0; iteration < SOLVER_ITERATIONS; iteration++) {
+		for (const unsigned int* c = first; c != last; c++) {
+			Contact& contact = contacts[*c];
+			if (contact.normal_mass == 0.f)
+				continue;
+			vec2 tangent = { -contact.normal.y, contact.normal.x };
+
+			// Normal impulse, accumulated impulse can only push
+			vec2 relative_velocity = velocityOf(contact.b) - velocityOf(contact.a);
+			float lambda = contact.normal_mass * (-dot(relative_velocity, contact.normal) + contact.bias);
+			float old_impulse = contact.normal_impulse;
+			contact.normal_impulse = std::max(old_impulse + lambda, 0.f);
+			applyImpulse(contact, (contact.normal_impulse - old_impulse) * contact.normal);
+
+			// Friction, bounded by the normal impulse
+			relative_velocity = velocityOf(contact.b) - velocityOf(contact.a);
+			lambda = -contact.normal_mass * dot(relative_velocity, tangent);
+			float max_friction = FRICTION * contact.normal_impulse;
+			old_impulse = contact.tangent_impulse;
+			contact.tangent_impulse = std::max(-max_friction, std::min(old_impulse + lambda, max_friction));
+			applyImpulse(contact, (contact.tangent_impulse - old_impulse) * tangent);
+		}
+	}
+
+	// Keep the accumulated impulses for the next step
+	for (const unsigned int* c = first; c != last; c++) {
+		const Contact& contact = contacts[*c];
+		contact.cached->normal_impulse = contact.normal_impulse;
+		contact.cached->tangent_impulse = contact.tangent_impulse;
+	}
+}
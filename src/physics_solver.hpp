@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+#include "components.hpp"
+#include "contact_cache.hpp"
+#include "worker_pool.hpp"
+
+// Sequential impulse solver for the circular physics bodies (pebbles and turtles).
+// Contacts are generated from the pairs found by the PhysicsSystem, solved with warm
+// started impulses and Baumgarte position correction, and bodies that come to rest
+// are put to sleep so that piles on the floor stop costing anything.
+// Bodies that touch form islands, islands don't share any moving body and are solved
+// in parallel. The result doesn't depend on the number of threads.
+class ContactSolver
+{
+public:
+	// Starts a new step, bodies are identified by their index in registry.motions
+	void begin(size_t body_count);
+
+	void addBody(unsigned int index, Entity& entity, Motion& motion, Physics& physics);
+
+	// Generates a contact if the two bodies overlap, wakes sleeping bodies that get hit.
+	// The cached pair state provides the warm start and receives the new impulses.
+	void addContact(unsigned int index_a, unsigned int index_b, CachedContact& cached);
+
+	// Contacts of the falling bodies with the bottom of the window
+	void addFloorContacts(float floor_y, ContactCache& cache);
+
+	// Resolves all contacts and updates the sleep state of the bodies
+	void solve(float elapsed_ms, WorkerPool& workers);
+
+private:
+	struct Body
+	{
+		Entity* entity = nullptr;
+		Motion* motion = nullptr;
+		Physics* physics = nullptr;
+		float inv_mass = 0.f;
+		float radius = 0.f;
+	};
+
+	struct Contact
+	{
+		unsigned int a, b;      // body indices, b == FLOOR for the floor
+		vec2 normal;            // from a to b
+		float separation;       // negative when penetrating
+		float normal_impulse;   // accumulated over the iterations, warm starts the next step
+		float tangent_impulse;
+		float normal_mass;
+		float bias;
+		bool touching;          // false if only the bounding circles overlap
+		CachedContact* cached;
+	};
+
+	// Ranges in island_bodies and island_contacts
+	struct Island
+	{
+		unsigned int first_body, body_count;
+		unsigned int first_contact, contact_count;
+	};
+
+	static const unsigned int FLOOR = ~0u;
+
+	vec2 velocityOf(unsigned int index) const;
+	float invMassOf(unsigned int index) const;
+	void applyImpulse(const Contact& contact, vec2 impulse);
+	void wake(Body& body);
+
+	unsigned int findRoot(unsigned int index);
+	void buildIslands();
+	void solveIsland(const Island& island, float step_seconds);
+
+	std::vector<Body> bodies;
+	std::vector<Contact> contacts;
+
+	// Union-find over the moving bodies, rebuilt every step
+	std::vector<unsigned int> island_parent;
+	std::vector<Island> islands;
+	std::vector<unsigned int> island_bodies;
+	std::vector<unsigned int> island_contacts;
+};
@@ -1,31 +1,9 @@
 // internal
 #include "physics_system.hpp"
+#include "debug_draw.hpp"
+#include "spatial_index.hpp"
 #include "world_init.hpp"
 
-namespace {
-	vec2 computeCollisionVelocity(Entity entity, Entity entity_other) {
-		auto& motion_entity = registry.motions.get(entity);
-		auto& motion_entity_other = registry.motions.get(entity_other);
-		auto& physics_entity = registry.physics.get(entity);
-		auto& physics_entity_other = registry.physics.get(entity_other);
-
-		float distSquared = (float)pow(motion_entity.position.x - motion_entity_other.position.x, 2) + (float)pow(motion_entity.position.y - motion_entity_other.position.y, 2);
-
-		vec2 num = (motion_entity.velocity - motion_entity_other.velocity) * (motion_entity.position - motion_entity_other.position);
-		num = num / distSquared;
-		num = num * (motion_entity.position - motion_entity_other.position);
-		float coeff = (2.f * physics_entity_other.mass) / (physics_entity.mass + physics_entity_other.mass);
-
-		vec2 new_velocity = motion_entity.velocity - (coeff * num);
-
-		if (physics_entity.affectedByGravity) {
-			// new_velocity *= -1.f;
-		}
-
-		return new_velocity;
-	}
-}
-
 // Returns the local bounding coordinates scaled by the current size of the entity
 vec2 get_bounding_box(const Motion& motion)
 {
@@ -64,8 +42,49 @@ bool collides(const Motion& motion1, const Motion& motion2)
 	return false;
 }
 
-bool checkPreciseCollisionWithSalmon(const Motion& salmonMotion, const Motion& motion2)
+// Pixel-exact test between two sprites, only called once the circle test above passed
+bool spriteMasksOverlap(Entity entity1, const Motion& motion1, Entity entity2, const Motion& motion2)
+{
+	ivec2 top_left1, top_left2;
+	const BitMask& mask1 = registry.spriteMaskPtrs.get(entity1)->getWorldMask(motion1, top_left1);
+	const BitMask& mask2 = registry.spriteMaskPtrs.get(entity2)->getWorldMask(motion2, top_left2);
+	return masksOverlap(mask1, top_left1, mask2, top_left2);
+}
+
+// Swept version of collides() for bodies that moved further than their radius this step.
+// Finds the first time of impact of the two circles between prev_position and position
+// and moves both bodies back to it, so that the regular collision handling kicks in.
+bool sweptCollides(Motion& motion1, Motion& motion2)
+{
+	vec2 bounding_box_1 = get_bounding_box(motion1);
+	vec2 bounding_box_2 = get_bounding_box(motion2);
+	float radius = sqrt(dot(bounding_box_1 / 2.f, bounding_box_1 / 2.f)) + sqrt(dot(bounding_box_2 / 2.f, bounding_box_2 / 2.f));
+
+	// Relative motion p(t) = p0 + t * d for t in [0, 1], solve |p(t)| = radius
+	vec2 p0 = motion1.prev_position - motion2.prev_position;
+	vec2 d = (motion1.position - motion1.prev_position) - (motion2.position - motion2.prev_position);
+	float a = dot(d, d);
+	float b = dot(p0, d);
+	float c = dot(p0, p0) - radius * radius;
+	if (a <= 0.f || b >= 0.f)
+		return false; // not approaching each other
+	float discriminant = b * b - a * c;
+	if (discriminant < 0.f)
+		return false;
+	float toi = c <= 0.f ? 0.f : (-b - sqrt(discriminant)) / a;
+	if (toi > 1.f)
+		return false;
+
+	motion1.position = mix(motion1.prev_position, motion1.position, toi);
+	motion2.position = mix(motion2.prev_position, motion2.position, toi);
+	return true;
+}
+
+bool checkPreciseCollisionWithSalmon(const Motion& salmonMotion, Entity other, const Motion& motion2)
 {
+	// Test the salmon vertices against the sprite pixels if the other entity has a mask
+	SpriteMask* sprite_mask = registry.spriteMaskPtrs.has(other) ? registry.spriteMaskPtrs.get(other) : nullptr;
+
 	vec2 bounding_box_non_salmon = get_bounding_box(motion2);
 	float rx = motion2.position.x - bounding_box_non_salmon.x / 2.;
 	float ry = motion2.position.y - bounding_box_non_salmon.y / 2.;
@@ -80,7 +99,11 @@ bool checkPreciseCollisionWithSalmon(const Motion& salmonMotion, const Motion& m
 		transform.scale(salmonMotion.scale);
 
 		vec3 p = transform.mat * vec3(vertex.position.x, vertex.position.y, 1.0);
-		if (p.x >= rx &&         // right of the left edge AND
+		if (sprite_mask) {
+			if (sprite_mask->covers(motion2, { p.x, p.y }))
+				return true;
+		}
+		else if (p.x >= rx &&         // right of the left edge AND
 			p.x <= rx + rw &&    // left of the right edge AND
 			p.y >= ry &&         // below the top AND
 			p.y <= ry + rh) {    // above the bottom
@@ -96,35 +119,75 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 	// Move fish based on how much time has passed, this is to (partially) avoid
 	// having entities move at different speed based on the machine.
 	auto& motion_registry = registry.motions;
-	for(uint i = 0; i< motion_registry.size(); i++)
-	{
-		// !!! TODO A1: update motion.position based on step_seconds and motion.velocity
-		Motion& motion = motion_registry.components[i];
-		Entity entity = motion_registry.entities[i];
-
-		if (registry.players.has(entity) && registry.players.get(entity).collidesWithTopWall == true) {
-			// printf("inside detection statement\n");
-			vec2 bonding_box_i = get_bounding_box(motion);
-			float radius = sqrt(dot(bonding_box_i / 2.f, bonding_box_i / 2.f));
-			motion.position.y = radius;
-		} 
-		else if (registry.players.has(entity) && registry.players.get(entity).collidesWithBottomWall == true) {
-			// printf("inside detection statement\n");
-			vec2 bonding_box_i = get_bounding_box(motion);
-			float radius = sqrt(dot(bonding_box_i / 2.f, bonding_box_i / 2.f));
-			motion.position.y = window_height_px - radius;
+
+	const float step_seconds = 1.0f * (elapsed_ms / 1000.f);
+	const size_t motion_count = motion_registry.size();
+	motion_steps.resize(motion_count);
+
+	// Remember where everything was at the start of the tick for render interpolation
+	workers.parallelFor(motion_count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Motion& motion = motion_registry.components[i];
+			motion.prev_position = motion.position;
+			motion.prev_angle = motion.angle;
+			motion_steps[i].gravity = 0.f;
+			motion_steps[i].step_seconds = step_seconds;
 		}
-		else {
-		float step_seconds = 1.0f * (elapsed_ms / 1000.f);
-		if (registry.physics.has(entity)) {
-			auto& physics = registry.physics.get(entity);
-			if (physics.affectedByGravity) {
-				motion.velocity.y += physics.gravityAccel * elapsed_ms;
-			}
+	});
+
+	// Bodies that move more than their radius in one step need swept collision tests
+	std::vector<bool> continuous(motion_count, false);
+	// Sleeping bodies are neither moved nor tested against each other
+	std::vector<bool> asleep(motion_count, false);
+	solver.begin(motion_count);
+
+	// Physics bodies fall, or don't move at all while they sleep
+	for (uint p = 0; p < registry.physics.size(); p++) {
+		Entity entity = registry.physics.entities[p];
+		if (!motion_registry.has(entity))
+			continue;
+		Physics& physics = registry.physics.components[p];
+		uint i = motion_registry.index_of(entity);
+		solver.addBody(i, motion_registry.entities[i], motion_registry.components[i], physics);
+		if (physics.asleep) {
+			asleep[i] = true;
+			motion_steps[i].step_seconds = 0.f;
+		}
+		else if (physics.affectedByGravity) {
+			motion_steps[i].gravity = physics.gravityAccel * elapsed_ms;
 		}
-		motion.position.x = motion.position.x + (step_seconds * motion.velocity.x);
-		motion.position.y = motion.position.y + (step_seconds * motion.velocity.y);
+	}
+
+	// The salmon is held against the wall it touched instead of moving
+	for (uint p = 0; p < registry.players.size(); p++) {
+		Player& player = registry.players.components[p];
+		if (!player.collidesWithTopWall && !player.collidesWithBottomWall)
+			continue;
+		uint i = motion_registry.index_of(registry.players.entities[p]);
+		vec2 bonding_box_i = get_bounding_box(motion_registry.components[i]);
+		float radius = sqrt(dot(bonding_box_i / 2.f, bonding_box_i / 2.f));
+		motion_registry.components[i].position.y = player.collidesWithTopWall ? radius : window_height_px - radius;
+		motion_steps[i].step_seconds = 0.f;
+	}
+
+	// !!! TODO A1: update motion.position based on step_seconds and motion.velocity
+	workers.parallelFor(motion_count, 1024, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Motion& motion = motion_registry.components[i];
+			motion.velocity.y += motion_steps[i].gravity;
+			motion.position += motion_steps[i].step_seconds * motion.velocity;
 		}
+	});
+
+	for (uint p = 0; p < registry.physics.size(); p++) {
+		Entity entity = registry.physics.entities[p];
+		if (!motion_registry.has(entity))
+			continue;
+		uint i = motion_registry.index_of(entity);
+		const Motion& motion = motion_registry.components[i];
+		vec2 travel = motion.position - motion.prev_position;
+		vec2 bonding_box_i = get_bounding_box(motion);
+		continuous[i] = dot(travel, travel) > dot(bonding_box_i / 2.f, bonding_box_i / 2.f);
 	}
 
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
@@ -157,21 +220,28 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 			}
 		}
 
-		for(uint j = 0; j<motion_container.components.size(); j++) // i+1
+		// every pair is visited once, the contact cache reports it once
+		for(uint j = i + 1; j<motion_container.components.size(); j++)
 		{
-			if (i == j)
+			if (asleep[i] && asleep[j])
 				continue;
 
 			Motion& motion_j = motion_container.components[j];	
-			if (collides(motion_i, motion_j)) {
+			bool touching = collides(motion_i, motion_j);
+			if (!touching && (continuous[i] || continuous[j])) {
 				Entity entity_j = motion_container.entities[j];
-				
-				// handle collisions involing pebbles
-				if (registry.physics.has(entity_i) && registry.physics.has(entity_j)) {
-					vec2 new_vel_entity_i = computeCollisionVelocity(entity_i, entity_j);					
-					float step_seconds = 1.0f * (elapsed_ms / 1000.f);
-					motion_i.velocity = new_vel_entity_i;
-				}
+				// fast pebbles would otherwise tunnel through turtles and each other
+				if (registry.physics.has(entity_i) && registry.physics.has(entity_j))
+					touching = sweptCollides(motion_i, motion_j);
+			}
+			if (touching) {
+				Entity entity_j = motion_container.entities[j];
+
+				// narrow phase for sprites, the circles are much larger than the visible pixels
+				if (registry.spriteMaskPtrs.has(entity_i) && registry.spriteMaskPtrs.has(entity_j) &&
+					!spriteMasksOverlap(entity_i, motion_i, entity_j, motion_j))
+					continue;
+
 				// check for precise collisions for salmon
 				Entity* salmon = nullptr;
 				Entity* other = nullptr;
@@ -184,24 +254,48 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 				}
 				
 				if (salmon && registry.physics.has(*other) && registry.physics.get(*other).affectedByGravity == true) {
-					break;
+					continue;
 					// ignore
 				}
-				if (salmon && checkPreciseCollisionWithSalmon(registry.motions.get(*salmon), registry.motions.get(*other))) {
-					registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-					registry.collisions.emplace_with_duplicates(entity_j, entity_i);
-					break;
+				if (salmon && !checkPreciseCollisionWithSalmon(registry.motions.get(*salmon), *other, registry.motions.get(*other))) {
+					continue;
 				}
-				 // Create a collisions event
-				 // We are abusing the ECS system a bit in that we potentially insert muliple collisions for the same entity
-				if (!salmon) {
-					registry.collisions.emplace_with_duplicates(entity_i, entity_j);
-					registry.collisions.emplace_with_duplicates(entity_j, entity_i);
+
+				// The contact is kept across steps, the cache creates the collision events
+				CachedContact& cached = contacts.touch(entity_i, entity_j);
+
+				// handle collisions involing pebbles
+				if (registry.physics.has(entity_i) && registry.physics.has(entity_j)) {
+					solver.addContact(i, j, cached);
 				}
 			}
 		}
 	}
 
+	// Resolve the pebble and turtle contacts, pebbles come to rest on the bottom of the window
+	solver.addFloorContacts(window_height_px, contacts);
+	solver.solve(elapsed_ms, workers);
+
+	// Report begin, persist and end events once per pair
+	contacts.endStep();
+
+	// Whatever rested on a body that is gone has to fall again
+	for (uint i = 0; i < registry.collisions.size(); i++) {
+		if (registry.collisions.components[i].phase != CONTACT_PHASE::END)
+			continue;
+		Entity entity = registry.collisions.entities[i];
+		Entity entity_other = registry.collisions.components[i].other;
+		for (Entity e : { entity, entity_other }) {
+			if (registry.physics.has(e)) {
+				registry.physics.get(e).asleep = false;
+				registry.physics.get(e).sleep_timer_ms = 0.f;
+			}
+		}
+	}
+
+	// Queries for AI and gameplay see the resolved positions
+	spatial_index.rebuild();
+
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 	// TODO A2: HANDLE SALMON - WALL collisions HERE
 	// DON'T WORRY ABOUT THIS UNTIL ASSIGNMENT 2
@@ -257,44 +351,21 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 	// TODO A2: DRAW DEBUG INFO HERE on Salmon mesh collision
 	// DON'T WORRY ABOUT THIS UNTIL ASSIGNMENT 2
-	// You will want to use the createLine from world_init.hpp
+	// Use the DebugDraw from debug_draw.hpp
 	// !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 
 	// debugging of bounding boxes
 	if (debugging.in_debug_mode)
 	{
-		uint size_before_adding_new = (uint)motion_container.components.size();
-		for (uint i = 0; i < size_before_adding_new; i++)
+		for (uint i = 0; i < motion_container.components.size(); i++)
 		{
 			Motion& motion_i = motion_container.components[i];
 			Entity entity_i = motion_container.entities[i];
 
-			if (registry.debugComponents.has(entity_i)) {
-				continue;
-			}
-
-			// visualize the radius with two axis-aligned lines
+			// visualize the radius with an axis-aligned box
 			const vec2 bonding_box = get_bounding_box(motion_i);
 			float radius = sqrt(dot(bonding_box/2.f, bonding_box/2.f));
-
-			// Entity lowerLeftCorner = createLine({ motion_i.position.x - radius, motion_i.position.y + radius }, { 15, 15 });
-			// Entity upperRightCorner = createLine({ motion_i.position.x + radius, motion_i.position.y - radius }, { 15, 15 });
-
-			
-			vec2 line_scale1 = { motion_i.scale.x / 20, 2*radius };
-			// Entity line1 = createLine(motion_i.position, line_scale1);
-			
-			vec2 line_scale2 = { 2*radius, motion_i.scale.x / 20};
-			// Entity line2 = createLine(motion_i.position, line_scale2);
-
-			Entity line3 = createLine({ motion_i.position.x, motion_i.position.y + radius }, line_scale2);
-
-			Entity line4 = createLine({ motion_i.position.x, motion_i.position.y - radius }, line_scale2);
-
-			Entity line5 = createLine({ motion_i.position.x + radius, motion_i.position.y }, line_scale1);
-
-			Entity line6 = createLine({ motion_i.position.x - radius, motion_i.position.y }, line_scale1);
-			// !!! TODO A2: implement debugging of bounding boxes and mesh
+			debug_draw.box(motion_i.position, { 2*radius, 2*radius });
 
 			if (registry.meshPtrs.has(entity_i)) {
 				auto& mesh = registry.meshPtrs.get(entity_i);
@@ -305,8 +376,7 @@ void PhysicsSystem::step(float elapsed_ms, float window_width_px, float window_h
 					transform.scale(motion_i.scale);
 
 					vec3 world_coord =  transform.mat * vec3(vertex.position.x, vertex.position.y, 1.0);
-					// printf("vertices: %f, %f", vertex.position.x, vertex.position.y);
-					Entity debugPoint = createLine({ world_coord.x, world_coord.y }, { 6, 6});
+					debug_draw.point({ world_coord.x, world_coord.y });
 				}
 			}
 		}
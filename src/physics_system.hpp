@@ -4,6 +4,11 @@
 #include "tiny_ecs.hpp"
 #include "components.hpp"
 #include "tiny_ecs_registry.hpp"
+#include "physics_solver.hpp"
+#include "worker_pool.hpp"
+
+// Pixel-exact test between two entities with sprite masks whose bounding circles touch
+bool spriteMasksOverlap(Entity entity1, const Motion& motion1, Entity entity2, const Motion& motion2);
 
 // A simple physics system that moves rigid bodies and checks for collision
 class PhysicsSystem
@@ -15,4 +20,23 @@ public:
 	{
 	}
 
+	// Threads used for integrating and for solving the islands, 1 runs serially
+	void setThreadCount(unsigned int thread_count) { workers.setThreadCount(thread_count); }
+	unsigned int threadCount() const { return workers.threadCount(); }
+	// Other systems run their parallel work on the same threads, between physics steps
+	WorkerPool& workerPool() { return workers; }
+
+private:
+	// Per entity inputs of the integration, indexed like the Motion container
+	struct MotionStep
+	{
+		float gravity = 0.f;      // added to velocity.y before moving, 0 for entities that don't fall
+		float step_seconds = 0.f; // 0 for entities that don't move
+	};
+
+	WorkerPool workers;
+	std::vector<MotionStep> motion_steps;
+	ContactCache contacts;
+	ContactSolver solver;
+
 };
\ No newline at end of file
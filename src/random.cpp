@@ -0,0 +1,136 @@
+// internal
+#include "random.hpp"
+
+// stlib
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RANDOM_SSE2 1
+#endif
+
+RandomService random_service;
+
+namespace {
+	// Expands the seed into well mixed state words (Vigna's splitmix64)
+	uint64_t splitMix64(uint64_t& x)
+	{
+		uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	inline uint32_t rotl(uint32_t x, int k)
+	{
+		return (x << k) | (x >> (32 - k));
+	}
+
+	// The upper 24 bits as a float in [0, 1)
+	inline float toUnitFloat(uint32_t x)
+	{
+		return (float)(x >> 8) * (1.f / 16777216.f);
+	}
+
+	// One xoshiro128+ step on (s0, s1, s2, s3), returns the output
+	inline uint32_t step(uint32_t& s0, uint32_t& s1, uint32_t& s2, uint32_t& s3)
+	{
+		uint32_t result = s0 + s3;
+		uint32_t t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = rotl(s3, 11);
+		return result;
+	}
+}
+
+RandomStream::RandomStream(uint64_t seed, uint64_t stream)
+{
+	uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ull);
+	for (int i = 0; i < 4; i += 2) {
+		uint64_t z = splitMix64(x);
+		state[i] = (uint32_t)z;
+		state[i + 1] = (uint32_t)(z >> 32);
+	}
+	for (int j = 0; j < 4; j++) {
+		for (int i = 0; i < 4; i += 2) {
+			uint64_t z = splitMix64(x);
+			lanes[i][j] = (uint32_t)z;
+			lanes[i + 1][j] = (uint32_t)(z >> 32);
+		}
+	}
+}
+
+uint32_t RandomStream::next()
+{
+	return step(state[0], state[1], state[2], state[3]);
+}
+
+float RandomStream::uniform()
+{
+	return toUnitFloat(next());
+}
+
+int RandomStream::uniformInt(int min, int max)
+{
+	// Multiply and shift instead of modulo, the bias is negligible for game ranges
+	uint64_t range = (uint64_t)((int64_t)max - min) + 1;
+	return (int)((int64_t)min + (int64_t)(((uint64_t)next() * range) >> 32));
+}
+
+void RandomStream::fillUniform(float* out, size_t count)
+{
+	size_t i = 0;
+#ifdef RANDOM_SSE2
+	__m128i s0 = _mm_load_si128((const __m128i*)lanes[0]);
+	__m128i s1 = _mm_load_si128((const __m128i*)lanes[1]);
+	__m128i s2 = _mm_load_si128((const __m128i*)lanes[2]);
+	__m128i s3 = _mm_load_si128((const __m128i*)lanes[3]);
+	const __m128 scale = _mm_set1_ps(1.f / 16777216.f);
+	for (; i + 4 <= count; i += 4) {
+		__m128i result = _mm_add_epi32(s0, s3);
+		__m128i t = _mm_slli_epi32(s1, 9);
+		s2 = _mm_xor_si128(s2, s0);
+		s3 = _mm_xor_si128(s3, s1);
+		s1 = _mm_xor_si128(s1, s2);
+		s0 = _mm_xor_si128(s0, s3);
+		s2 = _mm_xor_si128(s2, t);
+		s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+		// 24 bits fit a signed int, so the signed conversion is exact
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), scale));
+	}
+	_mm_store_si128((__m128i*)lanes[0], s0);
+	_mm_store_si128((__m128i*)lanes[1], s1);
+	_mm_store_si128((__m128i*)lanes[2], s2);
+	_mm_store_si128((__m128i*)lanes[3], s3);
+#else
+	for (; i + 4 <= count; i += 4)
+		for (int j = 0; j < 4; j++)
+			out[i + j] = toUnitFloat(step(lanes[0][j], lanes[1][j], lanes[2][j], lanes[3][j]));
+#endif
+	// The rest comes from the scalar generator
+	for (; i < count; i++)
+		out[i] = uniform();
+}
+
+RandomStream RandomService::stream(RANDOM_STREAM_ID id) const
+{
+	return RandomStream(global_seed, (uint64_t)id);
+}
+
+void RandomService::seed(uint64_t seed)
+{
+	global_seed = seed;
+	// Numbered after the system streams
+	for (unsigned int i = 0; i < MAX_WORKER_STREAMS; i++)
+		worker_streams[i].stream = RandomStream(global_seed, random_stream_count + i);
+}
+
+RandomStream& RandomService::workerStream(unsigned int worker)
+{
+	assert(worker < MAX_WORKER_STREAMS);
+	return worker_streams[worker].stream;
+}
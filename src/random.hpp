@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Independent streams of the RandomService, each system draws from its own so that a
+// run with the same seed plays out the same way
+enum class RANDOM_STREAM_ID {
+	WORLD = 0,
+	PARTICLES = WORLD + 1,
+	STREAM_COUNT = PARTICLES + 1
+};
+const int random_stream_count = (int)RANDOM_STREAM_ID::STREAM_COUNT;
+
+// xoshiro128+ generator, cheap to copy and to seed. Besides the scalar state it keeps
+// four more generators side by side for generating batches of floats with SSE2; the
+// scalar fallback computes the same numbers.
+class RandomStream
+{
+public:
+	RandomStream() : RandomStream(0, 0) {}
+	RandomStream(uint64_t seed, uint64_t stream);
+
+	uint32_t next();
+
+	// in [0, 1)
+	float uniform();
+	// in [min, max)
+	float uniform(float min, float max) { return min + (max - min) * uniform(); }
+	// in [min, max], both included
+	int uniformInt(int min, int max);
+
+	// count floats in [0, 1)
+	void fillUniform(float* out, size_t count);
+
+private:
+	uint32_t state[4];
+	// lanes[i][j] is state word i of batch generator j
+	alignas(16) uint32_t lanes[4][4];
+};
+
+// Hands out the streams for a global seed
+class RandomService
+{
+public:
+	// At least WorkerPool::MAX_THREADS
+	static const unsigned int MAX_WORKER_STREAMS = 64;
+
+	RandomService() { seed(0); }
+
+	// Streams handed out after this call depend on the seed only, the worker streams
+	// start over from the new seed
+	void seed(uint64_t seed);
+	uint64_t seed() const { return global_seed; }
+
+	RandomStream stream(RANDOM_STREAM_ID id) const;
+
+	// The stream of a WorkerPool worker, keyed on its worker index. With the same seed and
+	// thread count every worker draws the same numbers, however the threads are scheduled.
+	// Only the worker itself may use it.
+	RandomStream& workerStream(unsigned int worker);
+
+private:
+	// One cache line each, the workers draw from them at the same time
+	struct alignas(64) WorkerStream
+	{
+		RandomStream stream;
+	};
+
+	uint64_t global_seed = 0;
+	std::array<WorkerStream, MAX_WORKER_STREAMS> worker_streams;
+};
+
+extern RandomService random_service;
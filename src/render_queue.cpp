@@ -0,0 +1,50 @@
+// internal
+#include "render_queue.hpp"
+
+// stlib
+#include <cassert>
+#include <utility>
+
+uint64_t RenderQueue::makeKey(RENDER_LAYER layer, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, uint32_t depth)
+{
+	assert(depth <= MAX_DEPTH);
+	return ((uint64_t)layer << 56) | ((uint64_t)effect << 48) | ((uint64_t)texture << 40) | ((uint64_t)depth << 16);
+}
+
+void RenderQueue::sort()
+{
+	const size_t count = queue.size();
+	if (count < 2)
+		return;
+	scratch.resize(count);
+
+	// One histogram per byte of the key, all filled in a single pass
+	size_t histograms[8][256] = {};
+	for (const Item& item : queue)
+		for (int digit = 0; digit < 8; digit++)
+			histograms[digit][(item.key >> (8 * digit)) & 0xff]++;
+
+	Item* from = queue.data();
+	Item* to = scratch.data();
+	for (int digit = 0; digit < 8; digit++)
+	{
+		size_t* histogram = histograms[digit];
+		const unsigned int shift = 8 * digit;
+		// All keys share this byte, the pass wouldn't move anything
+		if (histogram[(from[0].key >> shift) & 0xff] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			size_t bucket_size = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucket_size;
+		}
+		for (size_t i = 0; i < count; i++)
+			to[histogram[(from[i].key >> shift) & 0xff]++] = from[i];
+		std::swap(from, to);
+	}
+	if (from != queue.data())
+		queue.swap(scratch);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "components.hpp"
+#include "tiny_ecs.hpp"
+
+// The entities to draw this frame, each with a 64 bit key that encodes the order they
+// are drawn in. From the most significant bits down:
+//   layer (8) | effect (8) | texture (8) | depth (24) | unused (16)
+// so sorting by key groups the draws by layer, then by effect and texture, which keeps
+// the state changes between draws to a minimum. Depth orders the entities within a
+// group, larger is drawn later. The sort is an LSD radix sort, linear and stable.
+class RenderQueue
+{
+public:
+	static const uint32_t MAX_DEPTH = (1u << 24) - 1;
+
+	struct Item
+	{
+		uint64_t key;
+		Entity entity;
+	};
+
+	static uint64_t makeKey(RENDER_LAYER layer, EFFECT_ASSET_ID effect, TEXTURE_ASSET_ID texture, uint32_t depth);
+	static EFFECT_ASSET_ID effectOf(uint64_t key) { return (EFFECT_ASSET_ID)((key >> 48) & 0xff); }
+
+	void clear() { queue.clear(); }
+	void push(uint64_t key, Entity entity) { queue.push_back({ key, entity }); }
+	// Sorts by key, items with equal keys keep the order they were pushed in
+	void sort();
+
+	const std::vector<Item>& items() const { return queue; }
+
+private:
+	std::vector<Item> queue;
+	// Ping pong storage of the sort passes
+	std::vector<Item> scratch;
+};
@@ -2,236 +2,252 @@
 #include "render_system.hpp"
 #include <SDL.h>
 
+#include "debug_draw.hpp"
+#include "particle_pool.hpp"
 #include "tiny_ecs_registry.hpp"
 
-void RenderSystem::drawDeathParticles(Entity entity, const mat3& projection)
+// stlib
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	// Blend the last two simulation ticks, taking the short way around for the angle
+	Transform interpolatedTransform(const Motion& motion, float alpha)
+	{
+		float delta_angle = motion.angle - motion.prev_angle;
+		delta_angle -= 2.f * M_PI * floorf((delta_angle + M_PI) / (2.f * M_PI));
+
+		Transform transform;
+		transform.translate(mix(motion.prev_position, motion.position, alpha));
+		transform.rotate(motion.prev_angle + alpha * delta_angle);
+		transform.scale(motion.scale);
+		return transform;
+	}
+}
+
+void RenderSystem::drawDeathParticles(Entity entity)
 {
-	auto& particle = registry.deathParticles.get(entity);
-	if (!particle.faded) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-		//Transform transform;
-		//transform.translate(particle.motion.position);
-		//transform.rotate(particle.motion.angle);
-		//transform.scale(particle.motion.scale);
-
-		const GLuint used_effect_enum = (GLuint)EFFECT_ASSET_ID::PARTICLE;
-		const GLuint program = (GLuint)effects[used_effect_enum];
-
-		// Setting shaders
-		glUseProgram(program);
-		gl_has_errors();
-
-		const GLuint vbo = vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SPRITE];
-		const GLuint ibo = index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SPRITE];
-
-		// Setting vertex and index buffers
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-		gl_has_errors();
-
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		// GLint in_part_pos_loc = glGetAttribLocation(program, "in_part_pos");
-		// printf("at line 40\n");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
-
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-			sizeof(TexturedVertex), (void*)0);
-		gl_has_errors();
-
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void*)sizeof(vec3)); // note the stride to skip the preceeding vertex position
-
-		glEnableVertexAttribArray(4);
-		glBindBuffer(GL_ARRAY_BUFFER, RenderSystem::particles_position_buffer);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, particle.deathParticles.size() * 4 * sizeof(float), particle.positions);
-		gl_has_errors();
-
-		glBindBuffer(GL_ARRAY_BUFFER, RenderSystem::particles_position_buffer);
-		glVertexAttribPointer(
-			4, // attribute. must match the layout in the shader.
-			4, // size : x + y + z + size => 4
-			GL_FLOAT, // type
-			GL_FALSE, // normalized?
-			0, // stride
-			(void*)0 // array buffer offset
-		);
-		gl_has_errors();
-
-		glVertexAttribDivisor(4, 1);
-		gl_has_errors();
-		// printf("no gl errors till line 69");
-
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
-		GLuint texture_id = texture_gl_handles[(GLuint)TEXTURE_ASSET_ID::DEATH_PARTICLE];
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
-
-
-		GLint currProgram;
-		glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-		GLuint projection_loc = glGetUniformLocation(currProgram, "projection");
-		glUniformMatrix3fv(projection_loc, 1, GL_FALSE, (float*)&projection);
-		gl_has_errors();
-
-		glUniform2f(glGetUniformLocation(currProgram, "scale"), (float)5., (float)5.);
-		gl_has_errors();
-		// printf("no gl errors till line 87");
-
-		auto& angle = particle.angle;
-		angle += 0.5;
-		if (angle >= (2 * M_PI)) {
-			angle = 0;
-		}
-		glUniform1f(glGetUniformLocation(currProgram, "angle"), angle);
+	const ParticleEmitter& emitter = registry.particleEmitters.get(entity);
 
-		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particle.deathParticles.size());
-		gl_has_errors();
+	// the pool keeps the instances in the layout of the attribute, they are copied as is
+	GLintptr offset = 0;
+	if (!stream_buffer.push(particle_pool.instances(emitter), emitter.count * sizeof(vec4), sizeof(vec4), offset))
+		return;
 
-		glDisable(GL_BLEND);
-		// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	}
+	drawParticleInstances(stream_buffer.buffer(), offset, sizeof(vec4), emitter.count, emitter.angle);
+}
+
+void RenderSystem::drawGpuParticles()
+{
+	// Simulated by GpuParticles::step, the particles never leave the GPU
+	drawParticleInstances(gpu_particles.buffer(), 0, sizeof(GpuParticles::Particle), gpu_particles.count(), gpu_particles.angle());
+}
+
+void RenderSystem::drawParticleInstances(GLuint instances, GLintptr offset, GLsizei stride, GLsizei count, float angle)
+{
+	const PipelineState& state = pipeline(EFFECT_ASSET_ID::PARTICLE, GEOMETRY_BUFFER_ID::SPRITE);
+	bindPipeline(state);
+
+	// The instances come from different buffers, attribute 4 is pointed at the one to draw
+	gl_state.bindBuffer(GL_ARRAY_BUFFER, instances);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(
+		4, // attribute. must match the layout in the shader.
+		4, // size : x + y + z + size => 4
+		GL_FLOAT, // type
+		GL_FALSE, // normalized?
+		stride, // stride
+		(void*)offset // array buffer offset
+	);
+	glVertexAttribDivisor(4, 1);
+	gl_has_errors();
+
+	// Enabling and binding texture to slot 0
+	gl_state.bindTexture(0, atlas_texture);
+	gl_has_errors();
+
+	glUniform2f(state.scale_loc, 5.f, 5.f);
+	glUniform1f(state.angle_loc, angle);
+	glUniform4fv(state.uv_rect_loc, 1, (float*)&texture_uv_rects[(int)TEXTURE_ASSET_ID::DEATH_PARTICLE]);
+	gl_has_errors();
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+	frame_stats.draw_calls++;
+	gl_has_errors();
+}
+
+void RenderSystem::bindPipeline(const PipelineState& state)
+{
+	gl_state.useProgram(state.program);
+	gl_state.bindVertexArray(state.vao);
+	gl_state.setBlend(state.blend.enabled, state.blend.src, state.blend.dst);
+	gl_has_errors();
 }
 
-void RenderSystem::drawTexturedMesh(Entity entity,
-									const mat3 &projection)
+void RenderSystem::drawTexturedMesh(Entity entity)
 {
 	Motion &motion = registry.motions.get(entity);
 	// Transformation code, see Rendering and Transformation in the template
 	// specification for more info Incrementally updates transformation matrix,
 	// thus ORDER IS IMPORTANT
-	Transform transform;
-	transform.translate(motion.position);
-	transform.rotate(motion.angle);
-	transform.scale(motion.scale);
+	Transform transform = interpolatedTransform(motion, interpolation_alpha);
 	// !!! TODO A1: add rotation to the chain of transformations, mind the order
 	// of transformations
 
 	assert(registry.renderRequests.has(entity));
 	const RenderRequest &render_request = registry.renderRequests.get(entity);
+	assert(render_request.used_effect == EFFECT_ASSET_ID::SALMON);
+
+	const PipelineState& state = pipeline(render_request.used_effect, render_request.used_geometry);
+	bindPipeline(state);
+
+	if (render_request.used_effect == EFFECT_ASSET_ID::SALMON)
+	{
+		// Light up?
+		assert(state.light_up_loc >= 0);
+
+		// !!! TODO A1: set the light_up shader variable using glUniform1i,
+		// similar to the glUniform1f call below. The 1f or 1i specified the type, here a single int.
+		// registry.lightUpTimers.has(entity) ? glUniform1i(state.light_up_loc, 1) : glUniform1i(state.light_up_loc, 0);
+	}
 
-	const GLuint used_effect_enum = (GLuint)render_request.used_effect;
-	assert(used_effect_enum != (GLuint)EFFECT_ASSET_ID::EFFECT_COUNT);
-	const GLuint program = (GLuint)effects[used_effect_enum];
+	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	glUniform3fv(state.color_loc, 1, (float *)&color);
+	glUniformMatrix3fv(state.transform_loc, 1, GL_FALSE, (float *)&transform.mat);
+	gl_has_errors();
 
-	// Setting shaders
-	glUseProgram(program);
+	// Drawing of num_indices/3 triangles specified in the index buffer
+	glDrawElements(GL_TRIANGLES, state.index_count, GL_UNSIGNED_SHORT, nullptr);
+	frame_stats.draw_calls++;
 	gl_has_errors();
+}
 
-	assert(render_request.used_geometry != GEOMETRY_BUFFER_ID::GEOMETRY_COUNT);
-	const GLuint vbo = vertex_buffers[(GLuint)render_request.used_geometry];
-	const GLuint ibo = index_buffers[(GLuint)render_request.used_geometry];
+void RenderSystem::batchSprite(Entity entity)
+{
+	const Motion& motion = registry.motions.get(entity);
+	const RenderRequest& render_request = registry.renderRequests.get(entity);
+	assert(render_request.used_geometry == GEOMETRY_BUFFER_ID::SPRITE);
+	assert(render_request.used_texture != TEXTURE_ASSET_ID::TEXTURE_COUNT);
+
+	SpriteInstance instance;
+	instance.transform = interpolatedTransform(motion, interpolation_alpha).mat;
+	instance.color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	instance.uv_rect = texture_uv_rects[(int)render_request.used_texture];
+	sprite_instances.push_back(instance);
+}
 
-	// Setting vertex and index buffers
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+void RenderSystem::bindSpriteInstances(GLintptr offset)
+{
+	// The pipeline's VAO has to be bound, the attribute locations are those of textured.vs.glsl
+	gl_state.bindBuffer(GL_ARRAY_BUFFER, stream_buffer.buffer());
+	for (GLuint column = 0; column < 3; column++)
+		glVertexAttribPointer(2 + column, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(offset + column * sizeof(vec3)));
+	glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(offset + sizeof(mat3)));
+	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(offset + sizeof(mat3) + sizeof(vec3)));
 	gl_has_errors();
+}
+
+void RenderSystem::drawSpriteBatches()
+{
+	if (sprite_instances.empty())
+		return;
 
-	// Input data location as in the vertex buffer
-	if (render_request.used_effect == EFFECT_ASSET_ID::TEXTURED)
+	GLintptr offset = 0;
+	bool is_pushed = stream_buffer.push(sprite_instances.data(), sprite_instances.size() * sizeof(SpriteInstance), sizeof(vec4), offset);
+	assert(is_pushed && "Too many sprites for the stream buffer");
+	if (!is_pushed)
 	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_texcoord_loc = glGetAttribLocation(program, "in_texcoord");
-		gl_has_errors();
-		assert(in_texcoord_loc >= 0);
-
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-							  sizeof(TexturedVertex), (void *)0);
-		gl_has_errors();
-
-		glEnableVertexAttribArray(in_texcoord_loc);
-		glVertexAttribPointer(
-			in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex),
-			(void *)sizeof(
-				vec3)); // note the stride to skip the preceeding vertex position
-		// Enabling and binding texture to slot 0
-		glActiveTexture(GL_TEXTURE0);
-		gl_has_errors();
-
-		assert(registry.renderRequests.has(entity));
-		GLuint texture_id =
-			texture_gl_handles[(GLuint)registry.renderRequests.get(entity).used_texture];
-
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		gl_has_errors();
+		sprite_instances.clear();
+		return;
 	}
-	else if (render_request.used_effect == EFFECT_ASSET_ID::SALMON || render_request.used_effect == EFFECT_ASSET_ID::PEBBLE)
-	{
-		GLint in_position_loc = glGetAttribLocation(program, "in_position");
-		GLint in_color_loc = glGetAttribLocation(program, "in_color");
-		gl_has_errors();
 
-		glEnableVertexAttribArray(in_position_loc);
-		glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE,
-							  sizeof(ColoredVertex), (void *)0);
-		gl_has_errors();
+	const PipelineState& state = pipeline(EFFECT_ASSET_ID::TEXTURED, GEOMETRY_BUFFER_ID::SPRITE);
+	bindPipeline(state);
+	bindSpriteInstances(offset);
+	gl_state.bindTexture(0, atlas_texture);
+	gl_has_errors();
+
+	glDrawElementsInstanced(GL_TRIANGLES, state.index_count, GL_UNSIGNED_SHORT, nullptr, (GLsizei)sprite_instances.size());
+	gl_has_errors();
 
-		glEnableVertexAttribArray(in_color_loc);
-		glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE,
-							  sizeof(ColoredVertex), (void *)sizeof(vec3));
-		gl_has_errors();
+	frame_stats.draw_calls++;
+	frame_stats.sprite_batches++;
+	frame_stats.batched_sprites += (unsigned int)sprite_instances.size();
+	sprite_instances.clear();
+}
 
-		if (render_request.used_effect == EFFECT_ASSET_ID::SALMON)
-		{
-			// Light up?
-			GLint light_up_uloc = glGetUniformLocation(program, "light_up");
-			assert(light_up_uloc >= 0);
-
-			// !!! TODO A1: set the light_up shader variable using glUniform1i,
-			// similar to the glUniform1f call below. The 1f or 1i specified the type, here a single int.
-			// registry.lightUpTimers.has(entity) ? glUniform1i(light_up_uloc, 1) : glUniform1i(light_up_uloc, 0);
-			gl_has_errors();
-		}
-	}
-	else
+void RenderSystem::drawDebugLines()
+{
+	const std::vector<ColoredVertex>& vertices = debug_draw.vertices();
+	if (vertices.empty())
+		return;
+
+	// Aligned to whole vertices, the draw starts at the first one instead of
+	// pointing the attributes at the offset
+	GLintptr offset = 0;
+	if (!stream_buffer.push(vertices.data(), vertices.size() * sizeof(ColoredVertex), sizeof(ColoredVertex), offset))
+		return;
+
+	const PipelineState& state = pipeline(EFFECT_ASSET_ID::COLOURED, GEOMETRY_BUFFER_ID::DEBUG_LINE);
+	bindPipeline(state);
+	glDrawArrays(GL_LINES, (GLint)(offset / sizeof(ColoredVertex)), (GLsizei)vertices.size());
+	frame_stats.draw_calls++;
+	gl_has_errors();
+}
+
+void RenderSystem::batchPebble(Entity entity)
+{
+	const Motion& motion = registry.motions.get(entity);
+	PebbleInstance instance;
+	instance.center = mix(motion.prev_position, motion.position, interpolation_alpha);
+	instance.radius = 0.5f * std::max(fabsf(motion.scale.x), fabsf(motion.scale.y));
+	// Pebbles are shades of grey
+	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
+	instance.brightness = std::max(color.r, std::max(color.g, color.b));
+	pebble_instances.push_back(instance);
+}
+
+void RenderSystem::drawPebbleBatch()
+{
+	if (pebble_instances.empty())
+		return;
+
+	GLintptr offset = 0;
+	bool is_pushed = stream_buffer.push(pebble_instances.data(), pebble_instances.size() * sizeof(PebbleInstance), sizeof(vec4), offset);
+	assert(is_pushed && "Too many pebbles for the stream buffer");
+	if (!is_pushed)
 	{
-		assert(false && "Type of render request not supported");
+		pebble_instances.clear();
+		return;
 	}
 
-	// Getting uniform locations for glUniform* calls
-	GLint color_uloc = glGetUniformLocation(program, "fcolor");
-	const vec3 color = registry.colors.has(entity) ? registry.colors.get(entity) : vec3(1);
-	glUniform3fv(color_uloc, 1, (float *)&color);
+	const PipelineState& state = pipeline(EFFECT_ASSET_ID::PEBBLE, GEOMETRY_BUFFER_ID::SPRITE);
+	bindPipeline(state);
+	gl_state.bindBuffer(GL_ARRAY_BUFFER, stream_buffer.buffer());
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(PebbleInstance), (void*)offset);
 	gl_has_errors();
 
-	// Get number of indices from index buffer, which has elements uint16_t
-	GLint size = 0;
-	glGetBufferParameteriv(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+	glDrawElementsInstanced(GL_TRIANGLES, state.index_count, GL_UNSIGNED_SHORT, nullptr, (GLsizei)pebble_instances.size());
 	gl_has_errors();
 
-	GLsizei num_indices = size / sizeof(uint16_t);
-	// GLsizei num_triangles = num_indices / 3;
+	frame_stats.draw_calls++;
+	frame_stats.sprite_batches++;
+	frame_stats.batched_pebbles += (unsigned int)pebble_instances.size();
+	pebble_instances.clear();
+}
 
-	GLint currProgram;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &currProgram);
-	// Setting uniform values to the currently bound program
-	GLuint transform_loc = glGetUniformLocation(currProgram, "transform");
-	glUniformMatrix3fv(transform_loc, 1, GL_FALSE, (float *)&transform.mat);
-	GLuint projection_loc = glGetUniformLocation(currProgram, "projection");
-	glUniformMatrix3fv(projection_loc, 1, GL_FALSE, (float *)&projection);
-	gl_has_errors();
-	// Drawing of num_indices/3 triangles specified in the index buffer
-	glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, nullptr);
-	gl_has_errors();
+void RenderSystem::flushBatch(EFFECT_ASSET_ID effect)
+{
+	if (effect == EFFECT_ASSET_ID::TEXTURED)
+		drawSpriteBatches();
+	else if (effect == EFFECT_ASSET_ID::PEBBLE)
+		drawPebbleBatch();
 }
 
 // draw the intermediate texture to the screen, with some distortion to simulate
 // water
 void RenderSystem::drawToScreen()
 {
-	// Setting shaders
-	// get the water texture, sprite mesh, and program
-	glUseProgram(effects[(GLuint)EFFECT_ASSET_ID::WATER]);
-	gl_has_errors();
 	// Clearing backbuffer
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h);
@@ -241,55 +257,109 @@ void RenderSystem::drawToScreen()
 	glClearColor(0, 0, 1.f, 1.0);
 	glClearDepth(1.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gl_state.setDepthTest(false);
 	gl_has_errors();
-	// Enabling alpha channel for textures
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
-	glDisable(GL_DEPTH_TEST);
-
-	// Draw the screen texture on the quad geometry
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]);
-	glBindBuffer(
-		GL_ELEMENT_ARRAY_BUFFER,
-		index_buffers[(GLuint)GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE]); // Note, GL_ELEMENT_ARRAY_BUFFER associates
-																	 // indices to the bound GL_ARRAY_BUFFER
-	gl_has_errors();
-	const GLuint water_program = effects[(GLuint)EFFECT_ASSET_ID::WATER];
-	// Set clock
-	GLuint time_uloc = glGetUniformLocation(water_program, "time");
-	GLuint dead_timer_uloc = glGetUniformLocation(water_program, "darken_screen_factor");
-	glUniform1f(time_uloc, (float)(glfwGetTime() * 10.0f));
-	ScreenState &screen = registry.screenStates.get(screen_state_entity);
-	glUniform1f(dead_timer_uloc, screen.darken_screen_factor);
-	
-	GLuint game_mode_uloc = glGetUniformLocation(water_program, "basic_mode");
-	registry.mode.components[0].basicMode ? glUniform1i(game_mode_uloc, 1) : glUniform1i(game_mode_uloc, 0);
 
-	gl_has_errors();
-	// Set the vertex position and vertex texture coordinates (both stored in the
-	// same VBO)
-	GLint in_position_loc = glGetAttribLocation(water_program, "in_position");
-	glEnableVertexAttribArray(in_position_loc);
-	glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void *)0);
-	gl_has_errors();
+	// Draw the screen texture on the screen triangle, alpha blended with the
+	// water shader
+	const PipelineState& state = pipeline(EFFECT_ASSET_ID::WATER, GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE);
+	bindPipeline(state);
 
+	// The clock and the screen state come from the frame uniforms
 	// Bind our texture in Texture Unit 0
-	glActiveTexture(GL_TEXTURE0);
-
-	glBindTexture(GL_TEXTURE_2D, off_screen_render_buffer_color);
+	gl_state.bindTexture(0, off_screen_render_buffer_color);
 	gl_has_errors();
 	// Draw
 	glDrawElements(
-		GL_TRIANGLES, 3, GL_UNSIGNED_SHORT,
+		GL_TRIANGLES, state.index_count, GL_UNSIGNED_SHORT,
 		nullptr); // one triangle = 3 vertices; nullptr indicates that there is
 				  // no offset from the bound index buffer
+	frame_stats.draw_calls++;
+	gl_has_errors();
+}
+
+void RenderSystem::uploadFrameUniforms()
+{
+	FrameUniforms uniforms;
+	mat3 projection = createProjectionMatrix();
+	for (int column = 0; column < 3; column++)
+		uniforms.projection[column] = vec4(projection[column], 0.f);
+	uniforms.time = (float)(glfwGetTime() * 10.0f);
+	uniforms.darken_screen_factor = registry.screenStates.get(screen_state_entity).darken_screen_factor;
+	uniforms.basic_mode = registry.mode.components[0].basicMode ? 1 : 0;
+	uniforms.padding = 0.f;
+
+	GLintptr offset = 0;
+	if (!stream_buffer.push(&uniforms, sizeof(uniforms), (size_t)std::max(uniform_buffer_alignment, 16), offset))
+	{
+		// The effects keep last frame's uniforms
+		fprintf(stderr, "No room for the frame uniforms in the stream buffer\n");
+		return;
+	}
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, stream_buffer.buffer(), offset, sizeof(uniforms));
 	gl_has_errors();
 }
 
+void RenderSystem::cullRenderables()
+{
+	vec2 view_min, view_max;
+	viewRect(view_min, view_max);
+
+	visible_entities.clear();
+	for (Entity entity : registry.renderRequests.entities)
+	{
+		if (!registry.motions.has(entity))
+			continue;
+		// Meshes and sprites span the unit square before scaling, the circle around it
+		// bounds every rotation
+		const Motion& motion = registry.motions.get(entity);
+		const vec2 center = mix(motion.prev_position, motion.position, interpolation_alpha);
+		const float radius = 0.5f * length(motion.scale);
+		if (center.x + radius < view_min.x || center.x - radius > view_max.x ||
+			center.y + radius < view_min.y || center.y - radius > view_max.y)
+		{
+			frame_stats.culled_entities++;
+			continue;
+		}
+		visible_entities.push_back(entity);
+	}
+	frame_stats.drawn_entities = (unsigned int)visible_entities.size();
+}
+
+void RenderSystem::buildRenderQueue()
+{
+	vec2 view_min, view_max;
+	viewRect(view_min, view_max);
+	const float view_height = std::max(view_max.y - view_min.y, 1.f);
+
+	render_queue.clear();
+	for (Entity entity : visible_entities)
+	{
+		// Lower on the screen is closer to the viewer and drawn later
+		const Motion& motion = registry.motions.get(entity);
+		const float y = mix(motion.prev_position.y, motion.position.y, interpolation_alpha);
+		const float depth = clamp((y - view_min.y) / view_height, 0.f, 1.f);
+
+		const RenderRequest& render_request = registry.renderRequests.get(entity);
+		render_queue.push(RenderQueue::makeKey(render_request.used_layer, render_request.used_effect,
+			render_request.used_texture, (uint32_t)(depth * RenderQueue::MAX_DEPTH)), entity);
+	}
+	render_queue.sort();
+}
+
 // Render our game world
 // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/
-void RenderSystem::draw()
+void RenderSystem::draw(float alpha)
 {
+	const auto frame_start = std::chrono::high_resolution_clock::now();
+	interpolation_alpha = alpha;
+	frame_stats = RenderStats();
+	// GL may have been called around the cache since the last frame
+	gl_state.beginFrame();
+	// Waits if the GPU is still reading this frame's region, three frames back
+	stream_buffer.beginFrame();
+	uploadFrameUniforms();
+
 	// Getting size of window
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h);
@@ -303,53 +373,93 @@ void RenderSystem::draw()
 	glClearColor(0, 0, 1, 1.0);
 	glClearDepth(1.f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDisable(GL_DEPTH_TEST); // native OpenGL does not work with a depth buffer
-							  // and alpha blending, one would have to sort
-							  // sprites back to front
+	// native OpenGL does not work with a depth buffer and alpha blending, one
+	// would have to sort sprites back to front
+	gl_state.setDepthTest(false);
 	gl_has_errors();
-	mat3 projection_2D = createProjectionMatrix();
+	// Particles drift away from their entity, they are drawn wherever it is
 	std::vector<Entity> needParticleEffects;
-	// Draw all textured meshes that have a position and size component
-	for (Entity entity : registry.renderRequests.entities)
+	for (Entity entity : registry.particleEmitters.entities)
 	{
-		if (!registry.motions.has(entity))
-			continue;
-		// Note, its not very efficient to access elements indirectly via the entity
-		// albeit iterating through all Sprites in sequence. A good point to optimize
-		if (registry.deathParticles.has(entity)) {
+		if (registry.renderRequests.has(entity) && registry.motions.has(entity))
 			needParticleEffects.push_back(entity);
+	}
+
+	// Draw all textured meshes that have a position and size component and are on screen,
+	// in the order of their keys. Consecutive sprites and consecutive pebbles are batched
+	// into one draw call each.
+	cullRenderables();
+	buildRenderQueue();
+	EFFECT_ASSET_ID batched_effect = EFFECT_ASSET_ID::EFFECT_COUNT;
+	for (const RenderQueue::Item& item : render_queue.items())
+	{
+		const EFFECT_ASSET_ID effect = RenderQueue::effectOf(item.key);
+		if (effect != batched_effect)
+		{
+			flushBatch(batched_effect);
+			batched_effect = effect;
 		}
-		drawTexturedMesh(entity, projection_2D);
+		if (effect == EFFECT_ASSET_ID::TEXTURED)
+			batchSprite(item.entity);
+		else if (effect == EFFECT_ASSET_ID::PEBBLE)
+			batchPebble(item.entity);
+		else
+			drawTexturedMesh(item.entity);
 	}
+	flushBatch(batched_effect);
+	drawDebugLines();
 
 	// Truely render to the screen
 	drawToScreen();
 
 	for (auto& entity : needParticleEffects) {
-		drawDeathParticles(entity, projection_2D);
+		drawDeathParticles(entity);
 	}
-	//if (registry.deathParticles.size() > 0) {
-	//	drawDeathParticles(entity, projection_2D);
+	if (gpu_particles.count() > 0)
+		drawGpuParticles();
+	//if (registry.particleEmitters.size() > 0) {
+	//	drawDeathParticles(entity);
 	//}
+	stream_buffer.endFrame();
+
+	frame_stats.state_changes_issued = gl_state.counters().issued;
+	frame_stats.state_changes_elided = gl_state.counters().elided;
+	frame_stats.streamed_bytes = stream_buffer.bytesPushed();
+	frame_stats.stream_stalls = stream_buffer.stalls();
+
+	// The swap waits for the display, it isn't part of the frame's CPU time
+	cpu_time_sum_ms += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - frame_start).count();
+	if (++cpu_time_frames == CPU_TIME_FRAMES)
+	{
+		average_cpu_frame_ms = cpu_time_sum_ms / CPU_TIME_FRAMES;
+		cpu_time_sum_ms = 0.f;
+		cpu_time_frames = 0;
+	}
+	frame_stats.cpu_frame_ms = average_cpu_frame_ms;
 
 	// flicker-free display with a double buffer
 	glfwSwapBuffers(window);
 	gl_has_errors();
 }
 
-mat3 RenderSystem::createProjectionMatrix()
+void RenderSystem::viewRect(vec2& out_min, vec2& out_max)
 {
-	// Fake projection matrix, scales with respect to window coordinates
-	float left = 0.f;
-	float top = 0.f;
-
 	int w, h;
 	glfwGetFramebufferSize(window, &w, &h);
 	gl_has_errors();
-	float right = (float)w / screen_scale;
-	float bottom = (float)h / screen_scale;
+	out_min = { 0.f, 0.f };
+	out_max = { (float)w / screen_scale, (float)h / screen_scale };
+}
+
+mat3 RenderSystem::createProjectionMatrix()
+{
+	// Fake projection matrix, scales with respect to window coordinates
+	vec2 view_min, view_max;
+	viewRect(view_min, view_max);
+	float left = view_min.x;
+	float top = view_min.y;
+	float right = view_max.x;
+	float bottom = view_max.y;
 
 	float sx = 2.f / (right - left);
 	float sy = 2.f / (top - bottom);
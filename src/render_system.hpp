@@ -1,12 +1,94 @@
 #pragma once
 
 #include <array>
+#include <cassert>
 #include <utility>
 
 #include "common.hpp"
 #include "components.hpp"
+#include "gl_state_cache.hpp"
+#include "gpu_particles.hpp"
+#include "render_queue.hpp"
+#include "stream_buffer.hpp"
 #include "tiny_ecs.hpp"
 
+// Per instance data of a batched sprite, matches the instance attributes of textured.vs.glsl
+struct SpriteInstance
+{
+	mat3 transform;
+	vec3 color;
+	vec4 uv_rect; // where the sprite's texture is in the atlas
+};
+
+// Uniforms shared by all effects, the std140 layout of the FrameData block of the shaders.
+// Written once per frame into the stream buffer.
+struct FrameUniforms
+{
+	vec4 projection[3]; // std140 pads every column of a mat3 to a vec4
+	float time;
+	float darken_screen_factor;
+	int basic_mode;
+	float padding;
+};
+// Uniform buffer binding point of the FrameData block
+const GLuint FRAME_DATA_BINDING = 0;
+
+// Per instance data of a pebble, matches the instance attribute of pebble.vs.glsl. The
+// circle is computed by the fragment shader, all pebbles share the sprite quad.
+struct PebbleInstance
+{
+	vec2 center;
+	float radius;
+	float brightness;
+};
+
+struct BlendState
+{
+	bool enabled = false;
+	GLenum src = GL_SRC_ALPHA;
+	GLenum dst = GL_ONE_MINUS_SRC_ALPHA;
+};
+
+// Everything about drawing an effect with a geometry that doesn't change between
+// frames, built once at startup. A draw binds it, sets the per draw uniforms and draws.
+struct PipelineState
+{
+	GLuint program = 0;
+	GLuint vao = 0;          // vertex and index buffer with the attribute layout specified
+	GLsizei index_count = 0;
+	BlendState blend;
+
+	// Uniform locations, -1 if the effect doesn't have the uniform
+	GLint transform_loc = -1;
+	GLint color_loc = -1;
+	GLint light_up_loc = -1;
+	GLint scale_loc = -1;
+	GLint angle_loc = -1;
+	GLint uv_rect_loc = -1;
+};
+
+// Counters of the last drawn frame
+struct RenderStats
+{
+	unsigned int draw_calls = 0;
+	unsigned int sprite_batches = 0;
+	unsigned int batched_sprites = 0;
+	unsigned int batched_pebbles = 0;
+	// Calls into the GlStateCache that reached GL and the ones that were redundant
+	unsigned int state_changes_issued = 0;
+	unsigned int state_changes_elided = 0;
+	// Dynamic data written into the stream buffer, and the times it made the CPU wait
+	size_t streamed_bytes = 0;
+	unsigned int stream_stalls = 0;
+	// Render requests that passed the visibility test and the ones outside the view
+	unsigned int drawn_entities = 0;
+	unsigned int culled_entities = 0;
+	// CPU time of draw() up to the buffer swap, averaged over the last CPU_TIME_FRAMES
+	// frames. Compare builds with and without GL_CHECK_ERRORS to see what the checks cost.
+	float cpu_frame_ms = 0.f;
+};
+const unsigned int CPU_TIME_FRAMES = 60;
+
 // System responsible for setting up OpenGL and for rendering all the
 // visual entities in the game
 class RenderSystem {
@@ -17,8 +99,12 @@ class RenderSystem {
 	 * Whenever possible, add to these lists instead of creating dynamic state
 	 * it is easier to debug and faster to execute for the computer.
 	 */
-	std::array<GLuint, texture_count> texture_gl_handles;
+	// All textures are packed into one atlas, each one is a rect of it
+	GLuint atlas_texture;
+	std::array<vec4, texture_count> texture_uv_rects;
 	std::array<ivec2, texture_count> texture_dimensions;
+	// Alpha masks of the textures, used for pixel-exact collisions
+	std::array<SpriteMask, texture_count> sprite_masks;
 
 	// Make sure these paths remain in sync with the associated enumerators.
 	// Associated id with .obj path
@@ -47,8 +133,25 @@ class RenderSystem {
 
 	std::array<GLuint, geometry_count> vertex_buffers;
 	std::array<GLuint, geometry_count> index_buffers;
+	std::array<GLsizei, geometry_count> index_counts;
 	std::array<Mesh, geometry_count> meshes;
 
+	// The (effect, geometry) pairs that are drawn and their blend state
+	struct PipelineDesc
+	{
+		EFFECT_ASSET_ID effect;
+		GEOMETRY_BUFFER_ID geometry;
+		BlendState blend;
+	};
+	const std::vector<PipelineDesc> pipeline_descs = {
+		{ EFFECT_ASSET_ID::SALMON, GEOMETRY_BUFFER_ID::SALMON, { true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA } },
+		{ EFFECT_ASSET_ID::PEBBLE, GEOMETRY_BUFFER_ID::SPRITE, { true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA } },
+		{ EFFECT_ASSET_ID::COLOURED, GEOMETRY_BUFFER_ID::DEBUG_LINE, { false } },
+		{ EFFECT_ASSET_ID::TEXTURED, GEOMETRY_BUFFER_ID::SPRITE, { true, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA } },
+		{ EFFECT_ASSET_ID::PARTICLE, GEOMETRY_BUFFER_ID::SPRITE, { true, GL_SRC_ALPHA, GL_ONE } },
+		{ EFFECT_ASSET_ID::WATER, GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE, { true, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA } } };
+	std::array<std::array<PipelineState, geometry_count>, effect_count> pipelines;
+
 public:
 	// Initialize the window
 	bool init(int width, int height, GLFWwindow* window);
@@ -62,8 +165,12 @@ public:
 
 	void initializeGlMeshes();
 	Mesh& getMesh(GEOMETRY_BUFFER_ID id) { return meshes[(int)id]; };
+	SpriteMask& getSpriteMask(TEXTURE_ASSET_ID id) { return sprite_masks[(int)id]; };
+	GpuParticles& getGpuParticles() { return gpu_particles; };
 
 	void initializeGlGeometryBuffers();
+	// Builds the pipeline of every entry of pipeline_descs, needs the effects and geometry
+	void initializePipelines();
 	// Initialize the screen texture used as intermediate render target
 	// The draw loop first renders to this texture, then it is used for the water
 	// shader
@@ -72,17 +179,52 @@ public:
 	// Destroy resources associated to one or all entities created by the system
 	~RenderSystem();
 
-	// Draw all entities
-	void draw();
+	// Draw all entities, alpha in [0,1) is the fraction of a simulation tick elapsed since the last step
+	void draw(float alpha);
 
 	mat3 createProjectionMatrix();
+	// The part of the world that createProjectionMatrix maps onto the screen
+	void viewRect(vec2& out_min, vec2& out_max);
+
+	const RenderStats& stats() const { return frame_stats; }
 
 private:
+	const PipelineState& pipeline(EFFECT_ASSET_ID effect, GEOMETRY_BUFFER_ID geometry) const
+	{
+		const PipelineState& state = pipelines[(int)effect][(int)geometry];
+		assert(state.vao != 0 && "Pipeline missing from pipeline_descs");
+		return state;
+	}
+	void bindPipeline(const PipelineState& state);
+
 	// Internal drawing functions for each entity type
-	void drawTexturedMesh(Entity entity, const mat3& projection);
-	void drawDeathParticles(Entity entity, const mat3& projection);
+	void drawTexturedMesh(Entity entity);
+	// Queues a TEXTURED entity into the sprite batch
+	void batchSprite(Entity entity);
+	// One instanced draw for all queued sprites, they share the atlas
+	void drawSpriteBatches();
+	// Points the instance attributes of the sprite pipeline at 'offset' in the stream buffer
+	void bindSpriteInstances(GLintptr offset);
+	// Queues a PEBBLE entity, all queued pebbles are one instanced draw
+	void batchPebble(Entity entity);
+	void drawPebbleBatch();
+	// Draws the entities queued for 'effect' by batchSprite or batchPebble
+	void flushBatch(EFFECT_ASSET_ID effect);
+	// All lines of the DebugDraw in one draw
+	void drawDebugLines();
+	void drawDeathParticles(Entity entity);
+	void drawGpuParticles();
+	// Instanced particle quads, 'instances' holds x, y, 1, life every 'stride' bytes from 'offset'
+	void drawParticleInstances(GLuint instances, GLintptr offset, GLsizei stride, GLsizei count, float angle);
+	// Fills visible_entities with the render requests whose bounds overlap the view
+	void cullRenderables();
+	// Sorts the visible entities by their RenderQueue key
+	void buildRenderQueue();
+	// Streams the FrameUniforms of this frame and binds them for all effects
+	void uploadFrameUniforms();
 	void drawToScreen();
 	void initParticlesBuffer();
+	void initStreamBuffer();
 
 	// Window handle
 	GLFWwindow* window;
@@ -95,8 +237,32 @@ private:
 	GLuint off_screen_render_buffer_depth;
 
 	Entity screen_state_entity;
-	GLuint particles_position_buffer;
+	float interpolation_alpha = 1.f;
+	GpuParticles gpu_particles;
+
+	// Render requests of the current frame that are on screen, in registry order
+	std::vector<Entity> visible_entities;
+	// The visible entities in the order they are drawn
+	RenderQueue render_queue;
+	// Sprites of the current frame in draw order, streamed as one block of instances
+	std::vector<SpriteInstance> sprite_instances;
+	std::vector<PebbleInstance> pebble_instances;
+	// Instances, CPU particles and the frame uniforms of the frames in flight
+	StreamBuffer stream_buffer;
+	GLint uniform_buffer_alignment = 0;
+
+	RenderStats frame_stats;
+	float cpu_time_sum_ms = 0.f;
+	unsigned int cpu_time_frames = 0;
+	float average_cpu_frame_ms = 0.f;
+	GlStateCache gl_state;
 };
 
 bool loadEffectFromFile(
-	const std::string& vs_path, const std::string& fs_path, std::string& gs_path, GLuint& out_program);
+	const std::string& vs_path, const std::string& fs_path, GLuint& out_program);
+
+// Vertex shader only program whose outputs are captured into a buffer
+bool loadTransformFeedbackEffect(
+	const std::string& vs_path, const char* const* varyings, int varying_count, GLuint& out_program);
+
+bool gl_compile_shader(GLuint shader);
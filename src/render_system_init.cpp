@@ -6,6 +6,7 @@
 
 #include "../ext/stb_image/stb_image.h"
 
+#include "texture_atlas.hpp"
 // This creates circular header inclusion, that is quite bad.
 #include "tiny_ecs_registry.hpp"
 
@@ -13,6 +14,11 @@
 #include <iostream>
 #include <sstream>
 
+// Pixels around each sprite in the texture atlas, enough for linear filtering
+const int ATLAS_PADDING = 2;
+// Bytes of dynamic data per frame, room for about 30000 sprites
+const size_t STREAM_BUFFER_FRAME_SIZE = 2 << 20;
+
 // World initialization
 bool RenderSystem::init(int width, int height, GLFWwindow* window_arg)
 {
@@ -38,10 +44,10 @@ bool RenderSystem::init(int width, int height, GLFWwindow* window_arg)
 	screen_scale = static_cast<float>(fb_width) / width;
 	(int)height; // dummy to avoid warning
 
-	// ASK(Camilo): Setup error callback. This can not be done in mac os, so do not enable
-	// it unless you are on Linux or Windows. You will need to change the window creation
-	// code to use OpenGL 4.3 (not suported on mac) and add additional .h and .cpp
-	// glDebugMessageCallback((GLDEBUGPROC)errorCallback, nullptr);
+	// Let the driver report errors as they happen, where KHR_debug is available (not
+	// on mac). Otherwise debug builds fall back to glGetError after the calls.
+	if (gl_enable_debug_output())
+		printf("OpenGL debug output enabled\n");
 
 	// We are not really using VAO's but without at least one bound we will crash in
 	// some systems.
@@ -53,6 +59,7 @@ bool RenderSystem::init(int width, int height, GLFWwindow* window_arg)
 	initScreenTexture();
     initializeGlTextures();
 	initializeGlEffects();
+	initStreamBuffer();
 	initializeGlGeometryBuffers();
 	initParticlesBuffer();
 
@@ -61,29 +68,51 @@ bool RenderSystem::init(int width, int height, GLFWwindow* window_arg)
 
 void RenderSystem::initializeGlTextures()
 {
-    glGenTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	std::vector<stbi_uc*> images(texture_paths.size());
+	std::vector<TextureAtlas::Image> atlas_images;
+	for(uint i = 0; i < texture_paths.size(); i++)
+	{
+		const std::string& path = texture_paths[i];
+		ivec2& dimensions = texture_dimensions[i];
 
-    for(uint i = 0; i < texture_paths.size(); i++)
-    {
-        const std::string& path = texture_paths[i];
-        ivec2& dimensions = texture_dimensions[i];
+		images[i] = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
+		if (images[i] == NULL)
+		{
+			const std::string message = "Could not load the file " + path + ".";
+			fprintf(stderr, "%s", message.c_str());
+			assert(false);
+		}
+		// Keep a 1-bit alpha mask on the CPU for pixel-exact collisions
+		SpriteMask::buildFromRGBA(images[i], dimensions.x, dimensions.y, sprite_masks[i]);
+		atlas_images.push_back({ images[i], dimensions });
+	}
 
-        stbi_uc* data;
-        data  = stbi_load(path.c_str(), &dimensions.x, &dimensions.y, NULL, 4);
+	// One texture for all sprites, so that any mix of them is drawn with one bind
+	GLint max_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+	TextureAtlas atlas;
+	const bool is_packed = atlas.build(atlas_images, ATLAS_PADDING, max_size);
+	for (uint i = 0; i < texture_paths.size(); i++)
+	{
+		texture_uv_rects[i] = is_packed ? atlas.uvRect(i) : vec4(0.f, 0.f, 1.f, 1.f);
+		stbi_image_free(images[i]);
+	}
+	if (!is_packed)
+	{
+		// The sprites are drawn without a texture
+		fprintf(stderr, "The textures don't fit into one %dx%d atlas\n", max_size, max_size);
+		assert(false);
+		atlas_texture = 0;
+		return;
+	}
 
-        if (data == NULL)
-        {
-			const std::string message = "Could not load the file " + path + ".";
-            fprintf(stderr, "%s", message.c_str());
-            assert(false);
-        }
-        glBindTexture(GL_TEXTURE_2D, texture_gl_handles[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dimensions.x, dimensions.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		gl_has_errors();
-        stbi_image_free(data);
-    }
+	glGenTextures(1, &atlas_texture);
+	glBindTexture(GL_TEXTURE_2D, atlas_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas.size().x, atlas.size().y, 0, GL_RGBA, GL_UNSIGNED_BYTE, atlas.pixels().data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	gl_has_errors();
 }
 
@@ -96,6 +125,12 @@ void RenderSystem::initializeGlEffects()
 
 		bool is_valid = loadEffectFromFile(vertex_shader_name, fragment_shader_name, effects[i]);
 		assert(is_valid && (GLuint)effects[i] != 0);
+
+		// All effects read the frame uniforms from the same binding
+		GLuint frame_data_index = glGetUniformBlockIndex(effects[i], "FrameData");
+		if (frame_data_index != GL_INVALID_INDEX)
+			glUniformBlockBinding(effects[i], frame_data_index, FRAME_DATA_BINDING);
+		gl_has_errors();
 	}
 }
 
@@ -111,6 +146,7 @@ void RenderSystem::bindVBOandIBO(GEOMETRY_BUFFER_ID gid, std::vector<T> vertices
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(uint)gid]);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
 		sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	index_counts[(uint)gid] = (GLsizei)indices.size();
 	gl_has_errors();
 }
 
@@ -159,55 +195,9 @@ void RenderSystem::initializeGlGeometryBuffers()
 	const std::vector<uint16_t> textured_indices = { 0, 3, 1, 1, 3, 2 };
 	bindVBOandIBO(GEOMETRY_BUFFER_ID::SPRITE, textured_vertices, textured_indices);
 
-	////////////////////////
-	// Initialize pebble
-	std::vector<ColoredVertex> pebble_vertices;
-	std::vector<uint16_t> pebble_indices;
-	constexpr float z = -0.1f;
-	constexpr int NUM_TRIANGLES = 62;
-
-	for (int i = 0; i < NUM_TRIANGLES; i++) {
-		const float t = float(i) * M_PI * 2.f / float(NUM_TRIANGLES - 1);
-		pebble_vertices.push_back({});
-		pebble_vertices.back().position = { 0.5 * cos(t), 0.5 * sin(t), z };
-		pebble_vertices.back().color = { 0.8, 0.8, 0.8 };
-	}
-	pebble_vertices.push_back({});
-	pebble_vertices.back().position = { 0, 0, 0 };
-	pebble_vertices.back().color = { 0.8, 0.8, 0.8 };
-	for (int i = 0; i < NUM_TRIANGLES; i++) {
-		pebble_indices.push_back((uint16_t)i);
-		pebble_indices.push_back((uint16_t)((i + 1) % NUM_TRIANGLES));
-		pebble_indices.push_back((uint16_t)NUM_TRIANGLES);
-	}
-	int geom_index = (int)GEOMETRY_BUFFER_ID::PEBBLE;
-	meshes[geom_index].vertices = pebble_vertices;
-	meshes[geom_index].vertex_indices = pebble_indices;
-	bindVBOandIBO(GEOMETRY_BUFFER_ID::PEBBLE, meshes[geom_index].vertices, meshes[geom_index].vertex_indices);
-
 	//////////////////////////////////
-	// Initialize debug line
-	std::vector<ColoredVertex> line_vertices;
-	std::vector<uint16_t> line_indices;
-
-	constexpr float depth = 0.5f;
-	constexpr vec3 red = { 0.8,0.1,0.1 };
-
-	// Corner points
-	line_vertices = {
-		{{-0.5,-0.5, depth}, red},
-		{{-0.5, 0.5, depth}, red},
-		{{ 0.5, 0.5, depth}, red},
-		{{ 0.5,-0.5, depth}, red},
-	};
-
-	// Two triangles
-	line_indices = {0, 1, 3, 1, 2, 3};
-	
-	geom_index = (int)GEOMETRY_BUFFER_ID::DEBUG_LINE;
-	meshes[geom_index].vertices = line_vertices;
-	meshes[geom_index].vertex_indices = line_indices;
-	bindVBOandIBO(GEOMETRY_BUFFER_ID::DEBUG_LINE, line_vertices, line_indices);
+	// Debug lines are streamed every frame, they have no buffers of their own
+	index_counts[(int)GEOMETRY_BUFFER_ID::DEBUG_LINE] = 0;
 
 	///////////////////////////////////////////////////////
 	// Initialize screen triangle (yes, triangle, not quad; its more efficient).
@@ -219,6 +209,95 @@ void RenderSystem::initializeGlGeometryBuffers()
 	// Counterclockwise as it's the default opengl front winding direction.
 	const std::vector<uint16_t> screen_indices = { 0, 1, 2 };
 	bindVBOandIBO(GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE, screen_vertices, screen_indices);
+
+	initializePipelines();
+}
+
+void RenderSystem::initializePipelines()
+{
+	GLint default_vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &default_vao);
+	for (const PipelineDesc& desc : pipeline_descs)
+	{
+		PipelineState& state = pipelines[(int)desc.effect][(int)desc.geometry];
+		state.program = effects[(GLuint)desc.effect];
+		state.index_count = index_counts[(GLuint)desc.geometry];
+		state.blend = desc.blend;
+
+		// The VAO keeps the index buffer and the attribute layout of the vertex type
+		glGenVertexArrays(1, &state.vao);
+		glBindVertexArray(state.vao);
+		// The debug lines are read from where they are streamed, see drawDebugLines
+		if (desc.geometry == GEOMETRY_BUFFER_ID::DEBUG_LINE)
+			glBindBuffer(GL_ARRAY_BUFFER, stream_buffer.buffer());
+		else
+			glBindBuffer(GL_ARRAY_BUFFER, vertex_buffers[(GLuint)desc.geometry]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffers[(GLuint)desc.geometry]);
+
+		GLint in_position_loc = glGetAttribLocation(state.program, "in_position");
+		GLint in_color_loc = glGetAttribLocation(state.program, "in_color");
+		GLint in_texcoord_loc = glGetAttribLocation(state.program, "in_texcoord");
+		if (desc.geometry == GEOMETRY_BUFFER_ID::SCREEN_TRIANGLE)
+		{
+			glEnableVertexAttribArray(in_position_loc);
+			glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+		}
+		else if (desc.geometry == GEOMETRY_BUFFER_ID::SPRITE)
+		{
+			glEnableVertexAttribArray(in_position_loc);
+			glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)0);
+			// Pebbles compute their circle from the position alone
+			if (in_texcoord_loc >= 0)
+			{
+				glEnableVertexAttribArray(in_texcoord_loc);
+				glVertexAttribPointer(in_texcoord_loc, 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex), (void*)sizeof(vec3));
+			}
+
+			// Batched sprites, locations as in textured.vs.glsl. The instances are
+			// streamed, every draw points the attributes at the ones of the frame.
+			if (desc.effect == EFFECT_ASSET_ID::TEXTURED)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, stream_buffer.buffer());
+				for (GLuint location = 2; location <= 6; location++)
+				{
+					glEnableVertexAttribArray(location);
+					glVertexAttribDivisor(location, 1);
+				}
+				for (GLuint column = 0; column < 3; column++)
+					glVertexAttribPointer(2 + column, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(column * sizeof(vec3)));
+				glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)sizeof(mat3));
+				glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void*)(sizeof(mat3) + sizeof(vec3)));
+			}
+			// Batched pebbles, location as in pebble.vs.glsl
+			else if (desc.effect == EFFECT_ASSET_ID::PEBBLE)
+			{
+				glBindBuffer(GL_ARRAY_BUFFER, stream_buffer.buffer());
+				glEnableVertexAttribArray(2);
+				glVertexAttribDivisor(2, 1);
+				glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(PebbleInstance), (void*)0);
+			}
+		}
+		else
+		{
+			glEnableVertexAttribArray(in_position_loc);
+			glVertexAttribPointer(in_position_loc, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)0);
+			if (in_color_loc >= 0)
+			{
+				glEnableVertexAttribArray(in_color_loc);
+				glVertexAttribPointer(in_color_loc, 3, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex), (void*)sizeof(vec3));
+			}
+		}
+		glBindVertexArray((GLuint)default_vao);
+		gl_has_errors();
+
+		state.transform_loc = glGetUniformLocation(state.program, "transform");
+		state.color_loc = glGetUniformLocation(state.program, "fcolor");
+		state.light_up_loc = glGetUniformLocation(state.program, "light_up");
+		state.scale_loc = glGetUniformLocation(state.program, "scale");
+		state.angle_loc = glGetUniformLocation(state.program, "angle");
+		state.uv_rect_loc = glGetUniformLocation(state.program, "uv_rect");
+		gl_has_errors();
+	}
 }
 
 RenderSystem::~RenderSystem()
@@ -227,14 +306,18 @@ RenderSystem::~RenderSystem()
 	// but it's polite to clean after yourself.
 	glDeleteBuffers((GLsizei)vertex_buffers.size(), vertex_buffers.data());
 	glDeleteBuffers((GLsizei)index_buffers.size(), index_buffers.data());
-	glDeleteTextures((GLsizei)texture_gl_handles.size(), texture_gl_handles.data());
+	glDeleteTextures(1, &atlas_texture);
 	glDeleteTextures(1, &off_screen_render_buffer_color);
 	glDeleteRenderbuffers(1, &off_screen_render_buffer_depth);
+	stream_buffer.destroy();
+	gpu_particles.destroy();
 	gl_has_errors();
 
 	for(uint i = 0; i < effect_count; i++) {
 		glDeleteProgram(effects[i]);
 	}
+	for (const PipelineDesc& desc : pipeline_descs)
+		glDeleteVertexArrays(1, &pipelines[(int)desc.effect][(int)desc.geometry].vao);
 	// delete allocated resources
 	glDeleteFramebuffers(1, &frame_buffer);
 	gl_has_errors();
@@ -375,11 +458,70 @@ bool loadEffectFromFile(
 	return true;
 }
 
+bool loadTransformFeedbackEffect(
+	const std::string& vs_path, const char* const* varyings, int varying_count, GLuint& out_program)
+{
+	std::ifstream vs_is(vs_path);
+	if (!vs_is.good())
+	{
+		fprintf(stderr, "Failed to load shader file %s", vs_path.c_str());
+		return false;
+	}
+	std::stringstream vs_ss;
+	vs_ss << vs_is.rdbuf();
+	std::string vs_str = vs_ss.str();
+	const char* vs_src = vs_str.c_str();
+	GLsizei vs_len = (GLsizei)vs_str.size();
+
+	GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vertex, 1, &vs_src, &vs_len);
+	if (!gl_compile_shader(vertex))
+	{
+		fprintf(stderr, "Vertex compilation failed: %s\n", vs_path.c_str());
+		return false;
+	}
+
+	// No fragment shader, the output is captured and rasterization is turned off.
+	// The varyings have to be declared before linking.
+	out_program = glCreateProgram();
+	glAttachShader(out_program, vertex);
+	glTransformFeedbackVaryings(out_program, varying_count, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(out_program);
+	glDetachShader(out_program, vertex);
+	glDeleteShader(vertex);
+	gl_has_errors();
+
+	GLint is_linked = GL_FALSE;
+	glGetProgramiv(out_program, GL_LINK_STATUS, &is_linked);
+	if (is_linked == GL_FALSE)
+	{
+		GLint log_len;
+		glGetProgramiv(out_program, GL_INFO_LOG_LENGTH, &log_len);
+		std::vector<char> log(log_len);
+		glGetProgramInfoLog(out_program, log_len, &log_len, log.data());
+		fprintf(stderr, "Link error: %s", log.data());
+		glDeleteProgram(out_program);
+		out_program = 0;
+		return false;
+	}
+	return true;
+}
+
+void RenderSystem::initStreamBuffer()
+{
+	// All per frame data goes through it, the sprite pipeline reads its instances from it
+	if (!stream_buffer.init(STREAM_BUFFER_FRAME_SIZE))
+	{
+		fprintf(stderr, "Failed to create the stream buffer\n");
+		assert(false);
+	}
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_buffer_alignment);
+	printf("Stream buffer %s\n", stream_buffer.persistent() ? "persistently mapped" : "mapped per upload");
+}
+
 void RenderSystem::initParticlesBuffer() {
-	GLuint particles_position_buffer;
-	glGenBuffers(1, &particles_position_buffer);
-	RenderSystem::particles_position_buffer = particles_position_buffer;
-	glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, 1000 * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+	// The GPU simulation is used if transform feedback works, the pool otherwise.
+	// The pool's particles are streamed like the other instances.
+	if (!gpu_particles.init())
+		fprintf(stderr, "GPU particles unavailable, simulating them on the CPU\n");
 }
@@ -0,0 +1,225 @@
+// internal
+#include "spatial_index.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+SpatialIndex spatial_index;
+
+// Roughly the size of a fish, larger entities are stored in every cell they overlap
+const float SPATIAL_CELL_PX = 64.f;
+
+namespace {
+	uint64_t cellKey(int x, int y)
+	{
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+	}
+}
+
+ivec2 SpatialIndex::cellOf(vec2 p) const
+{
+	return { (int)std::floor(p.x / SPATIAL_CELL_PX), (int)std::floor(p.y / SPATIAL_CELL_PX) };
+}
+
+void SpatialIndex::clear()
+{
+	entries.clear();
+	cell_items.clear();
+	cells.clear();
+	min_cell = { 0, 0 };
+	max_cell = { -1, -1 };
+}
+
+void SpatialIndex::rebuild()
+{
+	clear();
+	auto& motions = registry.motions;
+	entries.reserve(motions.size());
+	min_cell = { std::numeric_limits<int>::max(), std::numeric_limits<int>::max() };
+	max_cell = { std::numeric_limits<int>::min(), std::numeric_limits<int>::min() };
+	for (uint i = 0; i < motions.size(); i++) {
+		const Motion& motion = motions.components[i];
+		// the same bounding circle as the collision test of the PhysicsSystem
+		vec2 half_extent = abs(motion.scale) / 2.f;
+		float radius = sqrt(dot(half_extent, half_extent));
+		entries.push_back({ motions.entities[i], motion.position, radius, 0 });
+
+		ivec2 first = cellOf(motion.position - radius);
+		ivec2 last = cellOf(motion.position + radius);
+		min_cell = min(min_cell, first);
+		max_cell = max(max_cell, last);
+		for (int y = first.y; y <= last.y; y++)
+			for (int x = first.x; x <= last.x; x++)
+				cell_items.push_back({ cellKey(x, y), i });
+	}
+
+	// Group the items by cell, the entries keep the order of the motions within a cell
+	std::sort(cell_items.begin(), cell_items.end());
+	for (unsigned int i = 0; i < cell_items.size();) {
+		unsigned int end = i + 1;
+		while (end < cell_items.size() && cell_items[end].first == cell_items[i].first)
+			end++;
+		cells[cell_items[i].first] = { i, end };
+		i = end;
+	}
+	query_stamp = 0;
+}
+
+template <typename Visitor>
+void SpatialIndex::visitCells(vec2 min, vec2 max, Visitor visit)
+{
+	// Large entities are in several cells, the stamp reports them once per query
+	query_stamp++;
+	ivec2 first = glm::max(cellOf(min), min_cell);
+	ivec2 last = glm::min(cellOf(max), max_cell);
+	for (int y = first.y; y <= last.y; y++) {
+		for (int x = first.x; x <= last.x; x++) {
+			auto it = cells.find(cellKey(x, y));
+			if (it == cells.end())
+				continue;
+			for (unsigned int i = it->second.begin; i < it->second.end; i++) {
+				Entry& entry = entries[cell_items[i].second];
+				if (entry.query_stamp == query_stamp)
+					continue;
+				entry.query_stamp = query_stamp;
+				visit(entry);
+			}
+		}
+	}
+}
+
+bool SpatialIndex::accepts(Entry& entry, const SpatialFilter& filter)
+{
+	return !filter || filter(entry.entity);
+}
+
+std::vector<Entity> SpatialIndex::query_radius(vec2 center, float radius, const SpatialFilter& filter)
+{
+	std::vector<Entity> result;
+	visitCells(center - radius, center + radius, [&](Entry& entry) {
+		vec2 d = entry.position - center;
+		float reach = radius + entry.radius;
+		if (dot(d, d) <= reach * reach && accepts(entry, filter))
+			result.push_back(entry.entity);
+	});
+	return result;
+}
+
+std::vector<Entity> SpatialIndex::query_k_nearest(vec2 position, unsigned int k, const SpatialFilter& filter)
+{
+	std::vector<std::pair<float, Entry*>> found;
+	if (k == 0 || entries.empty())
+		return {};
+
+	// Grow the search circle until it holds k centers, everything outside is further away
+	float extent = SPATIAL_CELL_PX * (float)std::max(max_cell.x - min_cell.x + 1, max_cell.y - min_cell.y + 1);
+	vec2 grid_center = SPATIAL_CELL_PX * vec2(min_cell + max_cell + 1) / 2.f;
+	float max_radius = length(position - grid_center) + extent;
+	for (float radius = SPATIAL_CELL_PX;; radius *= 2.f) {
+		found.clear();
+		visitCells(position - radius, position + radius, [&](Entry& entry) {
+			vec2 d = entry.position - position;
+			float distance_squared = dot(d, d);
+			if (distance_squared <= radius * radius && accepts(entry, filter))
+				found.push_back({ distance_squared, &entry });
+		});
+		if (found.size() >= k || radius >= max_radius)
+			break;
+	}
+
+	auto nearer = [](const std::pair<float, Entry*>& a, const std::pair<float, Entry*>& b) { return a.first < b.first; };
+	size_t count = std::min<size_t>(k, found.size());
+	std::partial_sort(found.begin(), found.begin() + count, found.end(), nearer);
+
+	std::vector<Entity> result;
+	result.reserve(count);
+	for (size_t i = 0; i < count; i++)
+		result.push_back(found[i].second->entity);
+	return result;
+}
+
+std::vector<Entity> SpatialIndex::query_aabb(vec2 min, vec2 max, const SpatialFilter& filter)
+{
+	std::vector<Entity> result;
+	// every entry is stored in all the cells its circle overlaps, the box's cells are enough
+	visitCells(min, max, [&](Entry& entry) {
+		vec2 closest = clamp(entry.position, min, max);
+		vec2 d = entry.position - closest;
+		if (dot(d, d) <= entry.radius * entry.radius && accepts(entry, filter))
+			result.push_back(entry.entity);
+	});
+	return result;
+}
+
+bool SpatialIndex::raycast(vec2 origin, vec2 direction, float max_distance, RaycastHit& hit, const SpatialFilter& filter)
+{
+	float direction_length = length(direction);
+	if (direction_length <= 0.f || entries.empty())
+		return false;
+	direction /= direction_length;
+
+	// Walk the cells along the ray (Amanatides & Woo), a hit counts once the ray has
+	// left every cell that is closer than it
+	ivec2 cell = cellOf(origin);
+	ivec2 step = { direction.x < 0.f ? -1 : 1, direction.y < 0.f ? -1 : 1 };
+	const float inf = std::numeric_limits<float>::infinity();
+	vec2 t_delta = { direction.x != 0.f ? SPATIAL_CELL_PX / fabsf(direction.x) : inf,
+		direction.y != 0.f ? SPATIAL_CELL_PX / fabsf(direction.y) : inf };
+	vec2 next_boundary = SPATIAL_CELL_PX * vec2(cell + max(step, ivec2(0)));
+	vec2 t_max = { direction.x != 0.f ? (next_boundary.x - origin.x) / direction.x : inf,
+		direction.y != 0.f ? (next_boundary.y - origin.y) / direction.y : inf };
+
+	Entry* best = nullptr;
+	float best_t = max_distance;
+	query_stamp++;
+	for (float t_cell = 0.f; t_cell <= best_t;) {
+		// Nothing beyond the occupied cells
+		if ((step.x > 0 && cell.x > max_cell.x) || (step.x < 0 && cell.x < min_cell.x) ||
+			(step.y > 0 && cell.y > max_cell.y) || (step.y < 0 && cell.y < min_cell.y))
+			break;
+
+		auto it = cells.find(cellKey(cell.x, cell.y));
+		if (it != cells.end()) {
+			for (unsigned int i = it->second.begin; i < it->second.end; i++) {
+				Entry& entry = entries[cell_items[i].second];
+				if (entry.query_stamp == query_stamp)
+					continue;
+				entry.query_stamp = query_stamp;
+
+				// |origin + t * direction - position| = radius
+				vec2 m = origin - entry.position;
+				float b = dot(m, direction);
+				float c = dot(m, m) - entry.radius * entry.radius;
+				float discriminant = b * b - c;
+				if (discriminant < 0.f || (c > 0.f && b > 0.f))
+					continue;
+				float t = std::max(0.f, -b - sqrtf(discriminant));
+				if (t <= best_t && accepts(entry, filter)) {
+					best = &entry;
+					best_t = t;
+				}
+			}
+		}
+
+		if (t_max.x < t_max.y) {
+			t_cell = t_max.x;
+			t_max.x += t_delta.x;
+			cell.x += step.x;
+		}
+		else {
+			t_cell = t_max.y;
+			t_max.y += t_delta.y;
+			cell.y += step.y;
+		}
+	}
+
+	if (!best)
+		return false;
+	hit.entity = best->entity;
+	hit.distance = best_t;
+	hit.point = origin + best_t * direction;
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "tiny_ecs.hpp"
+
+// Entities that the callback rejects are skipped by the queries
+using SpatialFilter = std::function<bool(Entity)>;
+
+struct RaycastHit
+{
+	Entity entity;
+	vec2 point = { 0, 0 };
+	float distance = 0.f;
+};
+
+// Uniform grid over the bounding circles of everything with a Motion, so that AI and
+// gameplay code can find nearby entities without scanning whole containers.
+// Rebuilt by the PhysicsSystem at the end of every step; entities created or removed
+// since then are not reflected until the next rebuild.
+class SpatialIndex
+{
+public:
+	void rebuild();
+	void clear();
+
+	// Entities whose bounding circle overlaps the circle
+	std::vector<Entity> query_radius(vec2 center, float radius, const SpatialFilter& filter = nullptr);
+
+	// The k entities with the closest centers, nearest first
+	std::vector<Entity> query_k_nearest(vec2 position, unsigned int k, const SpatialFilter& filter = nullptr);
+
+	// Entities whose bounding circle overlaps the box
+	std::vector<Entity> query_aabb(vec2 min, vec2 max, const SpatialFilter& filter = nullptr);
+
+	// First bounding circle along the ray, direction doesn't need to be normalized
+	bool raycast(vec2 origin, vec2 direction, float max_distance, RaycastHit& hit, const SpatialFilter& filter = nullptr);
+
+private:
+	struct Entry
+	{
+		Entity entity;
+		vec2 position;
+		float radius;
+		unsigned int query_stamp;
+	};
+
+	// First and one past the last item of a cell in cell_items
+	struct CellRange
+	{
+		unsigned int begin, end;
+	};
+
+	ivec2 cellOf(vec2 p) const;
+	// Calls visit(entry_index) once per entry in the cells that overlap the box
+	template <typename Visitor>
+	void visitCells(vec2 min, vec2 max, Visitor visit);
+	bool accepts(Entry& entry, const SpatialFilter& filter);
+
+	std::vector<Entry> entries;
+	std::vector<std::pair<uint64_t, unsigned int>> cell_items; // cell key, entry index
+	std::unordered_map<uint64_t, CellRange> cells;
+	ivec2 min_cell = { 0, 0 }, max_cell = { -1, -1 }; // occupied cells
+	unsigned int query_stamp = 0;
+};
+
+extern SpatialIndex spatial_index;
@@ -0,0 +1,79 @@
+// internal
+#include "spatial_sort_system.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+
+// A pass over all containers starts every this many ticks. A full re-sort costs about
+// as much as two collision steps, bodies move little in 30 ticks so it pays off.
+const unsigned int SORT_PERIOD_TICKS = 30;
+// Size of a Morton grid cell, bodies in the same cell keep their order
+const float MORTON_CELL_PX = 16.f;
+
+namespace {
+	// Spreads the lower 16 bits of v to the even bits
+	uint32_t spreadBits(uint32_t v)
+	{
+		v &= 0xFFFF;
+		v = (v | (v << 8)) & 0x00FF00FF;
+		v = (v | (v << 4)) & 0x0F0F0F0F;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	uint32_t gridCoordinate(float px)
+	{
+		// Centered on 0 so that entities spawned outside the window still get distinct keys
+		float cell = std::floor(px / MORTON_CELL_PX) + 32768.f;
+		return (uint32_t)std::min(std::max(cell, 0.f), 65535.f);
+	}
+
+	uint32_t mortonKey(vec2 position)
+	{
+		return spreadBits(gridCoordinate(position.x)) | (spreadBits(gridCoordinate(position.y)) << 1);
+	}
+}
+
+void SpatialSortSystem::computeKeys()
+{
+	keys.clear();
+	keys.reserve(registry.motions.size());
+	for (uint i = 0; i < registry.motions.size(); i++)
+		keys[registry.motions.entities[i]] = mortonKey(registry.motions.components[i].position);
+}
+
+template <typename Component>
+void SpatialSortSystem::sortByKey(ComponentContainer<Component>& container)
+{
+	// Entities without a motion go to the back, ties keep the entity order to be deterministic
+	auto key_of = [&](Entity e) {
+		auto it = keys.find(e);
+		return it == keys.end() ? ~0ull : ((uint64_t)it->second << 32) | (unsigned int)e;
+	};
+	auto compare = [&](Entity a, Entity b) { return key_of(a) < key_of(b); };
+
+	// Piles that came to rest are already in order, don't move their components again
+	if (std::is_sorted(container.entities.begin(), container.entities.end(), compare))
+		return;
+	container.sort(compare);
+}
+
+void SpatialSortSystem::step()
+{
+	if (next_container == 0) {
+		if (tick++ % SORT_PERIOD_TICKS != 0)
+			return;
+		computeKeys();
+	}
+
+	// Only containers that are looked up while iterating the motions, the order of the
+	// render requests is the drawing order and stays untouched
+	switch (next_container) {
+	case 0: sortByKey(registry.motions); break;
+	case 1: sortByKey(registry.physics); break;
+	case 2: sortByKey(registry.spriteMaskPtrs); break;
+	}
+	next_container = (next_container + 1) % 3;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "common.hpp"
+#include "tiny_ecs_registry.hpp"
+
+// Keeps the motions, and the containers that are looked up alongside them, in Z-order
+// of the positions so that bodies that are close on screen are close in memory.
+// The sorting is spread over several ticks, one container per tick.
+class SpatialSortSystem
+{
+public:
+	void step();
+
+private:
+	void computeKeys();
+
+	template <typename Component>
+	void sortByKey(ComponentContainer<Component>& container);
+
+	unsigned int tick = 0;
+	unsigned int next_container = 0;
+	// Morton key of every entity with a motion, taken at the start of a pass
+	std::unordered_map<unsigned int, uint32_t> keys;
+};
@@ -0,0 +1,170 @@
+// internal
+#include "sprite_mask.hpp"
+#include "components.hpp"
+
+// stlib
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPRITE_MASK_SSE2 1
+#endif
+
+void BitMask::resize(int w, int h)
+{
+	width = w;
+	height = h;
+	words_per_row = (w + 63) / 64 + 2;
+	bits.assign((size_t)words_per_row * h, 0);
+}
+
+bool BitMask::test(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= width || y >= height)
+		return false;
+	return (bits[y * words_per_row + (x >> 6)] >> (x & 63)) & 1;
+}
+
+bool SpriteMask::buildFromRGBA(const unsigned char* rgba, int width, int height, SpriteMask& out_mask)
+{
+	if (rgba == nullptr || width <= 0 || height <= 0)
+		return false;
+
+	out_mask.texels.resize(width, height);
+	out_mask.world_masks.clear();
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			if (rgba[(y * width + x) * 4 + 3] > MASK_ALPHA_THRESHOLD)
+				out_mask.texels.set(x, y);
+	return true;
+}
+
+namespace {
+	uint64_t scaleKey(vec2 scale)
+	{
+		// The sign is kept, mirrored sprites (negative scale) get their own masks
+		int32_t sx = (int32_t)std::lround(scale.x);
+		int32_t sy = (int32_t)std::lround(scale.y);
+		return ((uint64_t)(uint32_t)sx << 32) | (uint32_t)sy;
+	}
+
+	int angleBucket(float angle)
+	{
+		float turns = angle / (2.f * (float)M_PI);
+		turns -= std::floor(turns);
+		return (int)std::lround(turns * MASK_ANGLE_BUCKETS) % MASK_ANGLE_BUCKETS;
+	}
+
+	// 64 bits of 'row' starting at bit 'bit' (>= 0)
+	inline uint64_t shiftedWord(const uint64_t* row, int bit)
+	{
+		int k = bit >> 6;
+		int sh = bit & 63;
+		uint64_t lo = row[k] >> sh;
+		uint64_t hi = sh ? row[k + 1] << (64 - sh) : 0;
+		return lo | hi;
+	}
+}
+
+void SpriteMask::prepare(vec2 scale)
+{
+	uint64_t key = scaleKey(scale);
+	if (world_masks.count(key) > 0)
+		return;
+
+	std::vector<RotatedMask>& rotations = world_masks[key];
+	rotations.resize(MASK_ANGLE_BUCKETS);
+	for (int b = 0; b < MASK_ANGLE_BUCKETS; b++)
+	{
+		float angle = b * 2.f * (float)M_PI / MASK_ANGLE_BUCKETS;
+		float c = cosf(angle);
+		float s = sinf(angle);
+
+		// Bounding box of the rotated sprite quad
+		float half_w = 0.5f * (fabsf(c) * fabsf(scale.x) + fabsf(s) * fabsf(scale.y));
+		float half_h = 0.5f * (fabsf(s) * fabsf(scale.x) + fabsf(c) * fabsf(scale.y));
+		RotatedMask& rotated = rotations[b];
+		rotated.origin = { (int)std::floor(-half_w), (int)std::floor(-half_h) };
+		int w = (int)std::ceil(half_w) - rotated.origin.x;
+		int h = (int)std::ceil(half_h) - rotated.origin.y;
+		rotated.mask.resize(w, h);
+
+		// Map every pixel center back into the texture, inverse of translate * rotate * scale
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				float px = rotated.origin.x + x + 0.5f;
+				float py = rotated.origin.y + y + 0.5f;
+				float u = (c * px + s * py) / scale.x + 0.5f;
+				float v = (-s * px + c * py) / scale.y + 0.5f;
+				if (u < 0.f || v < 0.f || u >= 1.f || v >= 1.f)
+					continue;
+				if (texels.test((int)(u * texels.width), (int)(v * texels.height)))
+					rotated.mask.set(x, y);
+			}
+		}
+	}
+}
+
+const BitMask& SpriteMask::getWorldMask(const Motion& motion, ivec2& out_top_left)
+{
+	prepare(motion.scale);
+	const RotatedMask& rotated = world_masks[scaleKey(motion.scale)][angleBucket(motion.angle)];
+	out_top_left = ivec2((int)std::lround(motion.position.x), (int)std::lround(motion.position.y)) + rotated.origin;
+	return rotated.mask;
+}
+
+bool SpriteMask::covers(const Motion& motion, vec2 p)
+{
+	ivec2 top_left;
+	const BitMask& mask = getWorldMask(motion, top_left);
+	return mask.test((int)std::floor(p.x) - top_left.x, (int)std::floor(p.y) - top_left.y);
+}
+
+bool masksOverlap(const BitMask& a, ivec2 a_top_left, const BitMask& b, ivec2 b_top_left)
+{
+	// Make 'a' the left-most mask, so that bit i of a row of 'b' is bit first_bit + i of 'a'
+	if (a_top_left.x > b_top_left.x)
+		return masksOverlap(b, b_top_left, a, a_top_left);
+
+	// Columns of 'a' that can overlap 'b'
+	const int first_bit = b_top_left.x - a_top_left.x;
+	const int last_bit = std::min(a.width, first_bit + b.width);
+	if (last_bit <= first_bit)
+		return false;
+
+	const int y0 = std::max(a_top_left.y, b_top_left.y);
+	const int y1 = std::min(a_top_left.y + a.height, b_top_left.y + b.height);
+
+	// Walk the words of 'b' and shift the matching bits of 'a' into place. Bits beyond
+	// the row width are zero and the rows are padded, so no masking is needed.
+	const int num_words = (last_bit - first_bit + 63) / 64;
+	for (int y = y0; y < y1; y++)
+	{
+		const uint64_t* row_a = a.row(y - a_top_left.y);
+		const uint64_t* row_b = b.row(y - b_top_left.y);
+		int w = 0;
+#ifdef SPRITE_MASK_SSE2
+		// Two words at a time, both words of a pair share the same shift
+		const __m128i sh = _mm_cvtsi32_si128(first_bit & 63);
+		const __m128i inv_sh = _mm_cvtsi32_si128(64 - (first_bit & 63));
+		for (; w + 1 < num_words; w += 2)
+		{
+			const uint64_t* src = row_a + ((first_bit >> 6) + w);
+			__m128i lo = _mm_srl_epi64(_mm_loadu_si128((const __m128i*)src), sh);
+			__m128i hi = (first_bit & 63) ? _mm_sll_epi64(_mm_loadu_si128((const __m128i*)(src + 1)), inv_sh) : _mm_setzero_si128();
+			__m128i both = _mm_and_si128(_mm_or_si128(lo, hi), _mm_loadu_si128((const __m128i*)(row_b + w)));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(both, _mm_setzero_si128())) != 0xFFFF)
+				return true;
+		}
+#endif
+		for (; w < num_words; w++)
+		{
+			if (shiftedWord(row_a, first_bit + 64 * w) & row_b[w])
+				return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+
+struct Motion;
+
+// Texels with an alpha above this value count as solid for collisions
+const int MASK_ALPHA_THRESHOLD = 128;
+
+// Number of precomputed rotations per sprite, angles are snapped to the nearest bucket
+const int MASK_ANGLE_BUCKETS = 64;
+
+// A packed 1-bit-per-pixel occupancy mask. Rows are stored as 64-bit words and padded
+// with two zero words, so the overlap test can read past the last word without checks.
+struct BitMask
+{
+	int width = 0;
+	int height = 0;
+	int words_per_row = 0;
+	std::vector<uint64_t> bits;
+
+	void resize(int w, int h);
+	void set(int x, int y) { bits[y * words_per_row + (x >> 6)] |= uint64_t(1) << (x & 63); }
+	bool test(int x, int y) const;
+	const uint64_t* row(int y) const { return &bits[y * words_per_row]; }
+};
+
+// Alpha mask of a sprite texture. World-space masks are rasterized once per scale the
+// sprite is used with, for all MASK_ANGLE_BUCKETS rotations, and looked up afterwards.
+struct SpriteMask
+{
+	static bool buildFromRGBA(const unsigned char* rgba, int width, int height, SpriteMask& out_mask);
+
+	// Rasterizes all angle buckets for the given (signed) scale, if not done yet
+	void prepare(vec2 scale);
+
+	// The mask of the sprite as placed by 'motion', out_top_left is the world pixel of its first bit
+	const BitMask& getWorldMask(const Motion& motion, ivec2& out_top_left);
+
+	// Is the world pixel 'p' covered by the sprite placed at 'motion'?
+	bool covers(const Motion& motion, vec2 p);
+
+	BitMask texels;
+
+private:
+	struct RotatedMask
+	{
+		BitMask mask;
+		ivec2 origin; // offset of the top-left pixel relative to the sprite center
+	};
+	std::unordered_map<uint64_t, std::vector<RotatedMask>> world_masks;
+};
+
+// Pixel-exact overlap test of two masks placed at the given world pixel offsets
+bool masksOverlap(const BitMask& a, ivec2 a_top_left, const BitMask& b, ivec2 b_top_left);
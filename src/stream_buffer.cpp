@@ -0,0 +1,138 @@
+// internal
+#include "stream_buffer.hpp"
+
+// stlib
+#include <cassert>
+#include <cstring>
+
+// How long to block for a fence at a time, in nanoseconds
+const GLuint64 FENCE_WAIT_NS = 1000000;
+
+bool StreamBuffer::init(size_t capacity)
+{
+	frame_capacity = capacity;
+	const GLsizeiptr size = (GLsizeiptr)(FRAMES * frame_capacity);
+
+	glGenBuffers(1, &buffer_id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+	if (gl3w_is_supported(4, 4) || gl_has_extension("GL_ARB_buffer_storage"))
+	{
+		// Coherent, the writes are seen by the draws issued after them without a flush
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+		if (mapped == nullptr)
+		{
+			// The storage is immutable, start over with a new buffer
+			glDeleteBuffers(1, &buffer_id);
+			glGenBuffers(1, &buffer_id);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+		}
+	}
+	if (mapped == nullptr)
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	frame = 0;
+	head = 0;
+	return !gl_has_errors();
+}
+
+void StreamBuffer::destroy()
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+	if (mapped)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		mapped = nullptr;
+	}
+	glDeleteBuffers(1, &buffer_id);
+	buffer_id = 0;
+}
+
+void StreamBuffer::beginFrame()
+{
+	frame = (frame + 1) % FRAMES;
+	head = frame * frame_capacity;
+	frame_stalls = 0;
+
+	GLsync& fence = fences[frame];
+	if (!fence)
+		return;
+	GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		frame_stalls++;
+		if (mapped)
+		{
+			// The mapping can't be replaced, the GPU has to catch up
+			while (status == GL_TIMEOUT_EXPIRED)
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_NS);
+		}
+		else
+		{
+			// Orphan the storage, the driver keeps the old one alive for the GPU and
+			// none of the regions is in use anymore
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+			glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(FRAMES * frame_capacity), nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			for (unsigned int i = 0; i < FRAMES; i++)
+			{
+				if (i != frame && fences[i])
+				{
+					glDeleteSync(fences[i]);
+					fences[i] = 0;
+				}
+			}
+		}
+	}
+	glDeleteSync(fence);
+	fence = 0;
+	gl_has_errors();
+}
+
+bool StreamBuffer::push(const void* data, size_t size, size_t alignment, GLintptr& out_offset)
+{
+	assert(alignment > 0);
+	const size_t offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > (frame + 1) * frame_capacity)
+		return false;
+
+	if (mapped)
+	{
+		memcpy(mapped + offset, data, size);
+	}
+	else
+	{
+		// Nothing in this region is read by the GPU, see beginFrame
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+		void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)offset, (GLsizeiptr)size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (range == nullptr)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			return false;
+		}
+		memcpy(range, data, size);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	head = offset + size;
+	out_offset = (GLintptr)offset;
+	return true;
+}
+
+void StreamBuffer::endFrame()
+{
+	assert(!fences[frame]);
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_has_errors();
+}
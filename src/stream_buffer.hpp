@@ -0,0 +1,46 @@
+#pragma once
+
+#include "common.hpp"
+
+// One GL buffer for all data that is written by the CPU every frame: instances, CPU
+// particles and the per frame uniforms. It is split into a region per frame in flight
+// and used as a ring, a frame only writes its own region. Where ARB_buffer_storage is
+// available the buffer stays mapped and data is copied straight into it, otherwise
+// every push maps its range unsynchronized. A fence at the end of the frame tells when
+// the GPU is done with the region, the mapped path waits for it before writing into
+// the region again, the other path orphans the buffer instead.
+class StreamBuffer
+{
+public:
+	// Frames that can be in flight before the CPU has to wait for the GPU
+	static const unsigned int FRAMES = 3;
+
+	// Allocates FRAMES regions of 'frame_capacity' bytes, needs a current GL context
+	bool init(size_t frame_capacity);
+	void destroy();
+
+	// Moves on to the next region, waits if the GPU still reads from it
+	void beginFrame();
+	// Copies 'size' bytes into the region of the frame at a multiple of 'alignment'.
+	// Returns false if the region is full, out_offset is the offset in buffer().
+	bool push(const void* data, size_t size, size_t alignment, GLintptr& out_offset);
+	// Fences the region, call after the last draw that reads from it
+	void endFrame();
+
+	GLuint buffer() const { return buffer_id; }
+	bool persistent() const { return mapped != nullptr; }
+
+	// Bytes pushed and the times the CPU waited for or orphaned a region, this frame
+	size_t bytesPushed() const { return head - frame * frame_capacity; }
+	unsigned int stalls() const { return frame_stalls; }
+
+private:
+	GLuint buffer_id = 0;
+	size_t frame_capacity = 0;
+	// Persistently mapped storage, null if the buffer is mapped per push
+	unsigned char* mapped = nullptr;
+	GLsync fences[FRAMES] = {};
+	unsigned int frame = 0;
+	size_t head = 0;
+	unsigned int frame_stalls = 0;
+};
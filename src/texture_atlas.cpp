@@ -0,0 +1,127 @@
+// internal
+#include "texture_atlas.hpp"
+
+// stlib
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+int TextureAtlas::fitAt(size_t i, int width, int atlas_width, int atlas_height, int height) const
+{
+	if (skyline[i].x + width > atlas_width)
+		return -1;
+	// The rect rests on the highest node it spans
+	int y = 0;
+	int remaining = width;
+	for (size_t j = i; remaining > 0; j++) {
+		if (j == skyline.size())
+			return -1;
+		y = std::max(y, skyline[j].y);
+		remaining -= skyline[j].width;
+	}
+	return y + height <= atlas_height ? y : -1;
+}
+
+void TextureAtlas::addNode(size_t i, ivec2 position, ivec2 size)
+{
+	skyline.insert(skyline.begin() + i, { position.x, position.y + size.y, size.x });
+
+	// Shrink or remove the nodes that are now covered
+	const int right = position.x + size.x;
+	for (size_t j = i + 1; j < skyline.size();) {
+		SkylineNode& node = skyline[j];
+		if (node.x >= right)
+			break;
+		int overlap = right - node.x;
+		if (overlap >= node.width) {
+			skyline.erase(skyline.begin() + j);
+			continue;
+		}
+		node.x += overlap;
+		node.width -= overlap;
+		break;
+	}
+
+	// Merge neighbours at the same height
+	for (size_t j = 0; j + 1 < skyline.size();) {
+		if (skyline[j].y == skyline[j + 1].y) {
+			skyline[j].width += skyline[j + 1].width;
+			skyline.erase(skyline.begin() + j + 1);
+		}
+		else {
+			j++;
+		}
+	}
+}
+
+bool TextureAtlas::pack(const std::vector<ivec2>& sizes, ivec2 atlas, std::vector<ivec2>& out_positions)
+{
+	skyline.assign(1, { 0, 0, atlas.x });
+	out_positions.assign(sizes.size(), ivec2(0));
+
+	// Tall rects first packs tighter
+	std::vector<size_t> order(sizes.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a].y > sizes[b].y; });
+
+	for (size_t r : order) {
+		// Bottom-left: the lowest spot, the left-most of those
+		size_t best_node = skyline.size();
+		int best_y = atlas.y;
+		for (size_t i = 0; i < skyline.size(); i++) {
+			int y = fitAt(i, sizes[r].x, atlas.x, atlas.y, sizes[r].y);
+			if (y >= 0 && y < best_y) {
+				best_y = y;
+				best_node = i;
+			}
+		}
+		if (best_node == skyline.size())
+			return false;
+		out_positions[r] = { skyline[best_node].x, best_y };
+		addNode(best_node, out_positions[r], sizes[r]);
+	}
+	return true;
+}
+
+bool TextureAtlas::build(const std::vector<Image>& images, int padding, int max_size)
+{
+	std::vector<ivec2> padded(images.size());
+	for (size_t i = 0; i < images.size(); i++)
+		padded[i] = images[i].size + 2 * padding;
+
+	// Grow the shorter side until everything fits
+	std::vector<ivec2> positions;
+	ivec2 atlas = { 64, 64 };
+	while (!pack(padded, atlas, positions)) {
+		if (atlas.x <= atlas.y)
+			atlas.x *= 2;
+		else
+			atlas.y *= 2;
+		if (atlas.x > max_size || atlas.y > max_size)
+			return false;
+	}
+
+	atlas_size = atlas;
+	atlas_pixels.assign((size_t)atlas.x * atlas.y * 4, 0);
+	uv_rects.resize(images.size());
+	for (size_t i = 0; i < images.size(); i++) {
+		const Image& image = images[i];
+		const ivec2 origin = positions[i] + padding;
+
+		// Copy the image and repeat its border into the padding
+		for (int y = -padding; y < image.size.y + padding; y++) {
+			int src_y = std::min(std::max(y, 0), image.size.y - 1);
+			for (int x = -padding; x < image.size.x + padding; x++) {
+				int src_x = std::min(std::max(x, 0), image.size.x - 1);
+				const unsigned char* src = image.rgba + ((size_t)src_y * image.size.x + src_x) * 4;
+				unsigned char* dst = atlas_pixels.data() + ((size_t)(origin.y + y) * atlas.x + origin.x + x) * 4;
+				memcpy(dst, src, 4);
+			}
+		}
+
+		uv_rects[i] = {
+			(float)origin.x / atlas.x, (float)origin.y / atlas.y,
+			(float)(origin.x + image.size.x) / atlas.x, (float)(origin.y + image.size.y) / atlas.y };
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "common.hpp"
+
+// Packs RGBA images into one texture with a skyline bottom-left packer. Every image is
+// surrounded by 'padding' pixels that repeat its border, so linear filtering at the
+// edge of a sprite doesn't pick up its neighbours.
+class TextureAtlas
+{
+public:
+	struct Image
+	{
+		const unsigned char* rgba;
+		ivec2 size;
+	};
+
+	// Packs the images into the smallest power of two atlas that fits, up to max_size
+	// on each side. Returns false if they don't fit.
+	bool build(const std::vector<Image>& images, int padding, int max_size);
+
+	ivec2 size() const { return atlas_size; }
+	const std::vector<unsigned char>& pixels() const { return atlas_pixels; }
+	// u0, v0, u1, v1 of image i, texcoords in [0, 1] of the image map into this rect
+	vec4 uvRect(size_t i) const { return uv_rects[i]; }
+
+private:
+	struct SkylineNode
+	{
+		int x, y, width;
+	};
+
+	// Places all rects, in order of decreasing height, false if the atlas is too small
+	bool pack(const std::vector<ivec2>& sizes, ivec2 atlas, std::vector<ivec2>& out_positions);
+	// Lowest y at which a rect of 'width' fits on the skyline starting at node i, -1 if it doesn't
+	int fitAt(size_t i, int width, int atlas_width, int atlas_height, int height) const;
+	void addNode(size_t i, ivec2 position, ivec2 size);
+
+	std::vector<SkylineNode> skyline;
+	ivec2 atlas_size = { 0, 0 };
+	std::vector<unsigned char> atlas_pixels;
+	std::vector<vec4> uv_rects;
+};
@@ -0,0 +1,133 @@
+// internal
+#include "timer_wheel.hpp"
+
+// stlib
+#include <cmath>
+
+TimerWheel::TimerWheel()
+{
+}
+
+TimerId TimerWheel::schedule(float time_ms, std::function<void()> callback)
+{
+	uint32_t index;
+	if (!free_timers.empty()) {
+		index = free_timers.back();
+		free_timers.pop_back();
+	}
+	else {
+		index = (uint32_t)timers.size();
+		timers.emplace_back();
+	}
+
+	Timer& timer = timers[index];
+	timer.callback = std::move(callback);
+	timer.active = true;
+	double due = std::ceil((double)time_ms);
+	timer.due_tick = due <= (double)current_tick ? current_tick + 1 : (uint64_t)due;
+	place(index);
+	return ((TimerId)timer.generation << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+	uint32_t index = (uint32_t)id;
+	if (index >= timers.size())
+		return false;
+	Timer& timer = timers[index];
+	if (!timer.active || timer.generation != (uint32_t)(id >> 32))
+		return false;
+	// The slot still refers to the timer, it is recycled once the wheel gets there
+	timer.active = false;
+	timer.callback = nullptr;
+	return true;
+}
+
+void TimerWheel::place(uint32_t index)
+{
+	uint64_t due = timers[index].due_tick;
+	for (int level = 0; level < LEVELS; level++) {
+		// The timer belongs to the lowest level on which it is in the current revolution
+		int upper_shift = SLOT_BITS * (level + 1);
+		if ((due >> upper_shift) == (current_tick >> upper_shift)) {
+			slots[level][(due >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(index);
+			return;
+		}
+	}
+	far_timers.push_back(index);
+}
+
+void TimerWheel::release(uint32_t index)
+{
+	Timer& timer = timers[index];
+	timer.active = false;
+	timer.callback = nullptr;
+	timer.generation++;
+	free_timers.push_back(index);
+}
+
+void TimerWheel::cascade(int level)
+{
+	std::vector<uint32_t> moved;
+	if (level == LEVELS)
+		moved.swap(far_timers);
+	else
+		moved.swap(slots[level][(current_tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+
+	for (uint32_t index : moved) {
+		if (timers[index].active)
+			place(index);
+		else
+			release(index);
+	}
+}
+
+void TimerWheel::advance(float elapsed_ms)
+{
+	const unsigned int start_epoch = epoch;
+	now_ms += elapsed_ms;
+	const uint64_t target_tick = (uint64_t)std::floor(now_ms);
+
+	while (current_tick < target_tick) {
+		current_tick++;
+
+		// Entering a new revolution of a level moves its next slot down, starting at
+		// the top so that timers coming down from several levels end up in level 0
+		int top_level = 0;
+		while (top_level < LEVELS && (current_tick & ((1ull << (SLOT_BITS * (top_level + 1))) - 1)) == 0)
+			top_level++;
+		for (int level = top_level; level >= 1; level--)
+			cascade(level);
+
+		// Callbacks may schedule or cancel timers, so the slot is emptied first
+		firing.clear();
+		firing.swap(slots[0][current_tick & (SLOTS - 1)]);
+		for (uint32_t index : firing) {
+			if (!timers[index].active) {
+				release(index);
+				continue;
+			}
+			std::function<void()> callback = std::move(timers[index].callback);
+			release(index);
+			callback();
+			if (epoch != start_epoch)
+				return;
+		}
+	}
+}
+
+void TimerWheel::clear()
+{
+	// The timers are recycled rather than dropped, so that old ids don't match new timers
+	free_timers.clear();
+	for (uint32_t index = 0; index < timers.size(); index++)
+		release(index);
+	for (auto& level : slots)
+		for (auto& slot : level)
+			slot.clear();
+	far_timers.clear();
+	firing.clear();
+	now_ms = 0.0;
+	current_tick = 0;
+	epoch++;
+}
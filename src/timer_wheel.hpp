@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "tiny_ecs.hpp"
+
+// 0 is never handed out
+typedef uint64_t TimerId;
+
+// Hierarchical timer wheel with millisecond ticks. Timers are scheduled at absolute
+// times of the wheel's clock and only touched again when they are about to expire, so
+// advancing costs in proportion to the timers that fire, not to the ones that wait.
+class TimerWheel
+{
+public:
+	TimerWheel();
+
+	// Current time of the wheel, advanced by advance()
+	float now() const { return (float)now_ms; }
+
+	// Calls 'callback' once the clock reaches time_ms. Times in the past fire on the next tick.
+	TimerId schedule(float time_ms, std::function<void()> callback);
+
+	// Removes the component of the entity at time_ms, e.g. to end a tag like LightUpTimer
+	template <typename Component>
+	TimerId scheduleRemoval(float time_ms, Entity entity, ComponentContainer<Component>& container)
+	{
+		return schedule(time_ms, [entity, &container]() { container.remove(entity); });
+	}
+
+	// Returns false if the timer already fired or was cancelled
+	bool cancel(TimerId id);
+
+	// Moves the clock forward and fires the expired timers in time order
+	void advance(float elapsed_ms);
+
+	// Drops all timers and resets the clock, safe to call from a callback
+	void clear();
+
+private:
+	static const int SLOT_BITS = 6;
+	static const unsigned int SLOTS = 1 << SLOT_BITS;
+	static const int LEVELS = 4; // 2^24 ms, about 4.6 hours, later timers wait in 'far_timers'
+
+	struct Timer
+	{
+		uint64_t due_tick = 0;
+		std::function<void()> callback;
+		uint32_t generation = 1;
+		bool active = false;
+	};
+
+	void place(uint32_t index);
+	void cascade(int level);
+	void release(uint32_t index);
+
+	std::vector<Timer> timers;
+	std::vector<uint32_t> free_timers;
+	std::vector<uint32_t> slots[LEVELS][SLOTS];
+	std::vector<uint32_t> far_timers;
+	std::vector<uint32_t> firing;
+
+	double now_ms = 0.0;
+	uint64_t current_tick = 0;
+	unsigned int epoch = 0; // changed by clear() to stop an advance() that is running
+};
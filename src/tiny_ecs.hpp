@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <memory>
 #include <vector>
 #include <unordered_map>
 #include <set>
@@ -17,9 +19,14 @@ public:
 	Entity()
 	{
 		id = id_count++;
-		// Note, indices of already deleted entities arent re-used in this simple implementation.
+		// Note, indices of deleted entities are only re-used by the EntityPools.
 	}
 	operator unsigned int() { return id; } // this enables automatic casting to int
+
+private:
+	// Only the pools hand out the ids of removed entities again
+	friend class EntityPools;
+	explicit Entity(unsigned int id) : id(id) {}
 };
 
 // Common interface to refer to all containers in the ECS registry
@@ -29,6 +36,7 @@ struct ContainerInterface
 	virtual size_t size() = 0;
 	virtual void remove(Entity e) = 0;
 	virtual bool has(Entity entity) = 0;
+	virtual void reserve(size_t count) = 0;
 };
 
 // A container that stores components of type 'Component' and associated entities
@@ -36,9 +44,49 @@ template <typename Component> // A component can be any class
 class ComponentContainer : public ContainerInterface
 {
 private:
-	// The hash map from Entity -> array index.
-	std::unordered_map<unsigned int, unsigned int> map_entity_componentID; // the entity is cast to uint to be hashable.
+	// Entity id -> array index, a paged sparse array rather than a hash map so that
+	// inserting and removing rarely allocates. A page covers PAGE_SIZE consecutive ids and
+	// is only allocated once one of them gets a component, so the memory follows the ids in
+	// use rather than the largest id ever handed out. Pages are kept until clear(), the
+	// pools keep reusing the same ids.
+	static const unsigned int NO_COMPONENT = ~0u;
+	static const unsigned int PAGE_BITS = 8;
+	static const unsigned int PAGE_SIZE = 1u << PAGE_BITS;
+	struct Page
+	{
+		std::array<unsigned int, PAGE_SIZE> index;
+	};
+	std::vector<std::unique_ptr<Page>> map_entity_componentID;
 	bool registered = false;
+
+	unsigned int lookup(unsigned int id) const
+	{
+		unsigned int page = id >> PAGE_BITS;
+		if (page >= map_entity_componentID.size() || !map_entity_componentID[page])
+			return NO_COMPONENT;
+		return map_entity_componentID[page]->index[id & (PAGE_SIZE - 1)];
+	}
+	// Maps an id that has no component yet
+	void assign(unsigned int id, unsigned int component_id)
+	{
+		unsigned int page = id >> PAGE_BITS;
+		if (page >= map_entity_componentID.size())
+			map_entity_componentID.resize(page + 1);
+		if (!map_entity_componentID[page]) {
+			map_entity_componentID[page].reset(new Page());
+			map_entity_componentID[page]->index.fill(NO_COMPONENT);
+		}
+		map_entity_componentID[page]->index[id & (PAGE_SIZE - 1)] = component_id;
+	}
+	// Moves an id that has a component
+	void reassign(unsigned int id, unsigned int component_id)
+	{
+		map_entity_componentID[id >> PAGE_BITS]->index[id & (PAGE_SIZE - 1)] = component_id;
+	}
+	void unassign(unsigned int id)
+	{
+		map_entity_componentID[id >> PAGE_BITS]->index[id & (PAGE_SIZE - 1)] = NO_COMPONENT;
+	}
 public:
 	// Container of all components of type 'Component'
 	std::vector<Component> components;
@@ -57,7 +105,7 @@ public:
 		// Usually, every entity should only have one instance of each component type
 		assert(!(check_for_duplicates && has(e)) && "Entity already contained in ECS registry");
 
-		map_entity_componentID[e] = (unsigned int)components.size();
+		assign(e, (unsigned int)components.size());
 		components.push_back(std::move(c)); // the move enforces move instead of copy constructor
 		entities.push_back(e);
 		return components.back();
@@ -76,12 +124,18 @@ public:
 	// A wrapper to return the component of an entity
 	Component& get(Entity e) {
 		assert(has(e) && "Entity not contained in ECS registry");
-		return components[map_entity_componentID[e]];
+		return components[lookup(e)];
+	}
+
+	// Position of the entity's component in 'components', valid until the next remove or sort
+	unsigned int index_of(Entity e) {
+		assert(has(e) && "Entity not contained in ECS registry");
+		return lookup(e);
 	}
 
 	// Check if entity has a component of type 'Component'
 	bool has(Entity entity) {
-		return map_entity_componentID.count(entity) > 0;
+		return lookup(entity) != NO_COMPONENT;
 	}
 
 	// Remove an component and pack the container to re-use the empty space
@@ -90,19 +144,19 @@ public:
 		if (has(e))
 		{
 			// Get the current position
-			int cID = map_entity_componentID[e];
+			unsigned int cID = lookup(e);
 
 			// Move the last element to position cID using the move operator
 			// Note, components[cID] = components.back() would trigger the copy instead of move operator
 			components[cID] = std::move(components.back());
 			entities[cID] = entities.back(); // the entity is only a single index, copy it.
-			map_entity_componentID[entities.back()] = cID;
+			reassign(entities.back(), cID);
 
-			// Erase the old component and free its memory
-			map_entity_componentID.erase(e);
+			// Erase the old component, the vectors keep their capacity for the next insert
+			unassign(e);
 			components.pop_back();
 			entities.pop_back();
-			// Note, one could mark the id for re-use
+			// Note, ids are only re-used for entities removed through the EntityPools
 		}
 	};
 
@@ -120,6 +174,13 @@ public:
 		return components.size();
 	}
 
+	// Makes room for 'count' components, inserting up to that many doesn't reallocate
+	void reserve(size_t count)
+	{
+		components.reserve(count);
+		entities.reserve(count);
+	}
+
 	// Sort the components and associated entity assignment structures by the comparisonFunction, see std::sort
 	template <class Compare>
 	void sort(Compare comparisonFunction)
@@ -130,8 +191,15 @@ public:
 		std::vector<Component> components_new; components_new.reserve(components.size());
 		std::transform(entities.begin(), entities.end(), std::back_inserter(components_new), [&](Entity e) { return std::move(get(e)); }); // note, the get still uses the old hash map (on purpose!)
 		components = std::move(components_new); // note, we use move operations to not create unneccesary copies of objects, but memory is still allocated for the new vector
-		// Fill the new hashmap
+		// Fill the new index map
 		for (unsigned int i = 0; i < entities.size(); i++)
-			map_entity_componentID[entities[i]] = i;
+			reassign(entities[i], i);
 	}
 };
+
+template <typename Component>
+const unsigned int ComponentContainer<Component>::NO_COMPONENT;
+template <typename Component>
+const unsigned int ComponentContainer<Component>::PAGE_BITS;
+template <typename Component>
+const unsigned int ComponentContainer<Component>::PAGE_SIZE;
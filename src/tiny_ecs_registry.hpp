@@ -13,21 +13,23 @@ public:
 	// Manually created list of all components this game has
 	// TODO: A1 add a LightUp component
 	ComponentContainer<Physics> physics;
-	ComponentContainer<DeathParticle> deathParticles;
+	ComponentContainer<ParticleEmitter> particleEmitters;
 	ComponentContainer<Mode> mode;
 	ComponentContainer<Pit> pits;
 	ComponentContainer<LightUpTimer> lightUpTimers;
 	ComponentContainer<DeathTimer> deathTimers;
+	ComponentContainer<Lifetime> lifetimes;
 	ComponentContainer<Motion> motions;
 	ComponentContainer<Collision> collisions;
 	ComponentContainer<Player> players;
 	ComponentContainer<Mesh*> meshPtrs;
+	ComponentContainer<SpriteMask*> spriteMaskPtrs;
 	ComponentContainer<RenderRequest> renderRequests;
 	ComponentContainer<ScreenState> screenStates;
 	ComponentContainer<SoftShell> softShells;
 	ComponentContainer<HardShell> hardShells;
-	ComponentContainer<DebugComponent> debugComponents;
 	ComponentContainer<vec3> colors;
+	ComponentContainer<Pooled> pooled;
 
 	// constructor that adds all containers for looping over them
 	// IMPORTANT: Don't forget to add any newly added containers!
@@ -35,21 +37,28 @@ public:
 	{
 		// TODO: A1 add a LightUp component
 		registry_list.push_back(&physics);
-		registry_list.push_back(&deathParticles);
+		registry_list.push_back(&particleEmitters);
 		registry_list.push_back(&mode);
 		registry_list.push_back(&pits);
 		registry_list.push_back(&lightUpTimers);
 		registry_list.push_back(&deathTimers);
+		registry_list.push_back(&lifetimes);
 		registry_list.push_back(&motions);
 		registry_list.push_back(&collisions);
 		registry_list.push_back(&players);
 		registry_list.push_back(&meshPtrs);
+		registry_list.push_back(&spriteMaskPtrs);
 		registry_list.push_back(&renderRequests);
 		registry_list.push_back(&screenStates);
 		registry_list.push_back(&softShells);
 		registry_list.push_back(&hardShells);
-		registry_list.push_back(&debugComponents);
 		registry_list.push_back(&colors);
+		registry_list.push_back(&pooled);
+	}
+
+	void reserve_all_components(size_t count) {
+		for (ContainerInterface* reg : registry_list)
+			reg->reserve(count);
 	}
 
 	void clear_all_components() {
@@ -0,0 +1,135 @@
+// internal
+#include "worker_pool.hpp"
+
+// stlib
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int thread_count) : next_index(0)
+{
+	setThreadCount(thread_count);
+}
+
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+void WorkerPool::setThreadCount(unsigned int thread_count)
+{
+	stop();
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	thread_count = std::min(thread_count, MAX_THREADS);
+
+	// Jobs are only published by this thread, a new worker must not mistake the
+	// last one for a new job
+	std::lock_guard<std::mutex> lock(mutex);
+	quit = false;
+	for (unsigned int i = 1; i < thread_count; i++)
+		workers.emplace_back(&WorkerPool::workerLoop, this, i, generation);
+}
+
+void WorkerPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake_workers.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void WorkerPool::runRanges()
+{
+	for (;;) {
+		size_t begin = next_index.fetch_add(grain);
+		if (begin >= count)
+			return;
+		(*task)(begin, std::min(begin + grain, count));
+	}
+}
+
+void WorkerPool::workerLoop(unsigned int worker, unsigned int start_generation)
+{
+	unsigned int seen_generation = start_generation;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake_workers.wait(lock, [&] { return quit || generation != seen_generation; });
+			if (quit)
+				return;
+			seen_generation = generation;
+		}
+
+		if (worker_task)
+			(*worker_task)(worker, threadCount());
+		else
+			runRanges();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished_workers++;
+		}
+		job_done.notify_one();
+	}
+}
+
+void WorkerPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& task)
+{
+	if (count == 0)
+		return;
+	grain = std::max<size_t>(grain, 1);
+
+	// Not worth waking anyone up
+	if (workers.empty() || count <= grain) {
+		for (size_t begin = 0; begin < count; begin += grain)
+			task(begin, std::min(begin + grain, count));
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		this->count = count;
+		this->grain = grain;
+		next_index = 0;
+	}
+	runJob();
+}
+
+void WorkerPool::forEachWorker(const std::function<void(unsigned int, unsigned int)>& task)
+{
+	if (workers.empty()) {
+		task(0, 1);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		worker_task = &task;
+	}
+	runJob();
+}
+
+void WorkerPool::runJob()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished_workers = 0;
+		generation++;
+	}
+	wake_workers.notify_all();
+
+	if (worker_task)
+		(*worker_task)(0, threadCount());
+	else
+		runRanges();
+
+	// Every worker checks in, the ones that woke up late find no work left
+	std::unique_lock<std::mutex> lock(mutex);
+	job_done.wait(lock, [&] { return finished_workers == workers.size(); });
+	task = nullptr;
+	worker_task = nullptr;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A small pool of threads that run parallel loops. The calling thread joins in on the
+// work, so a pool with a single thread runs everything serially on the caller.
+class WorkerPool
+{
+public:
+	// More threads than this are clamped
+	static const unsigned int MAX_THREADS = 64;
+
+	// thread_count includes the calling thread, 0 picks the number of hardware threads
+	explicit WorkerPool(unsigned int thread_count = 0);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	// Stops the current workers and starts thread_count - 1 new ones
+	void setThreadCount(unsigned int thread_count);
+	unsigned int threadCount() const { return (unsigned int)workers.size() + 1; }
+
+	// Calls task(begin, end) on ranges of at most 'grain' indices until [0, count) is
+	// covered and waits for all of them. Ranges run in any order on any thread.
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& task);
+
+	// Calls task(worker, worker_count) once on every thread and waits for all of them.
+	// Worker 0 is the calling thread, the others keep their index until the thread count
+	// changes, so work that is split by worker index goes to the same worker every run.
+	void forEachWorker(const std::function<void(unsigned int, unsigned int)>& task);
+
+private:
+	// Runs the jobs published after start_generation as the given worker
+	void workerLoop(unsigned int worker, unsigned int start_generation);
+	// Publishes the current job and waits until every worker checked in
+	void runJob();
+	void runRanges();
+	void stop();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake_workers;
+	std::condition_variable job_done;
+
+	// The current job, only changed while no worker is busy with it. Either a range task
+	// or a per worker task is set.
+	const std::function<void(size_t, size_t)>* task = nullptr;
+	const std::function<void(unsigned int, unsigned int)>* worker_task = nullptr;
+	size_t count = 0;
+	size_t grain = 1;
+	std::atomic<size_t> next_index;
+	unsigned int generation = 0;
+	unsigned int finished_workers = 0;
+	bool quit = false;
+};
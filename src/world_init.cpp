@@ -1,4 +1,5 @@
 #include "world_init.hpp"
+#include "entity_pool.hpp"
 #include "tiny_ecs_registry.hpp"
 
 Entity createSalmon(RenderSystem* renderer, vec2 pos)
@@ -12,6 +13,7 @@ Entity createSalmon(RenderSystem* renderer, vec2 pos)
 	// Setting initial motion values
 	Motion& motion = registry.motions.emplace(entity);
 	motion.position = pos;
+	motion.prev_position = pos; // nothing to interpolate from before the first tick
 	motion.angle = 0.f;
 	motion.velocity = { 3.f, 0.f };
 	motion.scale = mesh.original_size * 150.f;
@@ -31,7 +33,7 @@ Entity createSalmon(RenderSystem* renderer, vec2 pos)
 Entity createFish(RenderSystem* renderer, vec2 position)
 {
 	// Reserve en entity
-	auto entity = Entity();
+	auto entity = entity_pools.acquire(ARCHETYPE_ID::FISH);
 
 	// Store a reference to the potentially re-used mesh object
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::SPRITE);
@@ -42,10 +44,14 @@ Entity createFish(RenderSystem* renderer, vec2 position)
 	motion.angle = 0.f;
 	motion.velocity = { -50, 0 };
 	motion.position = position;
+	motion.prev_position = position; // nothing to interpolate from before the first tick
 
 	// Setting initial values, scale is negative to make it face the opposite way
 	motion.scale = vec2({ -FISH_BB_WIDTH, FISH_BB_HEIGHT });
 
+	// Pixel-exact collision mask of the sprite
+	registry.spriteMaskPtrs.emplace(entity, &renderer->getSpriteMask(TEXTURE_ASSET_ID::FISH));
+
 	// Create an (empty) Fish component to be able to refer to all fish
 	registry.softShells.emplace(entity);
 	registry.renderRequests.insert(
@@ -59,7 +65,7 @@ Entity createFish(RenderSystem* renderer, vec2 position)
 
 Entity createTurtle(RenderSystem* renderer, vec2 position)
 {
-	auto entity = Entity();
+	auto entity = entity_pools.acquire(ARCHETYPE_ID::TURTLE);
 
 	// Store a reference to the potentially re-used mesh object (the value is stored in the resource cache)
 	Mesh& mesh = renderer->getMesh(GEOMETRY_BUFFER_ID::SPRITE);
@@ -70,10 +76,14 @@ Entity createTurtle(RenderSystem* renderer, vec2 position)
 	motion.angle = 0.f;
 	motion.velocity = { -50.f, 0.f };
 	motion.position = position;
+	motion.prev_position = position; // nothing to interpolate from before the first tick
 
 	// Setting initial values, scale is negative to make it face the opposite way
 	motion.scale = vec2({ -TURTLE_BB_WIDTH, TURTLE_BB_HEIGHT });
 
+	// Pixel-exact collision mask of the sprite
+	registry.spriteMaskPtrs.emplace(entity, &renderer->getSpriteMask(TEXTURE_ASSET_ID::TURTLE));
+
 	auto& physics = registry.physics.emplace(entity);
 	physics.mass = 100.;
 
@@ -101,51 +111,35 @@ Entity createVortex(RenderSystem* renderer, vec2 position)
 	motion.angle = 0.f;
 	motion.velocity = { -50.f, 0.f };
 	motion.position = position;
+	motion.prev_position = position; // nothing to interpolate from before the first tick
 
 	// Setting initial values, scale is negative to make it face the opposite way
 	motion.scale = vec2({ VORTEX_BB_WIDTH, VORTEX_BB_HEIGHT });
 
+	// Pixel-exact collision mask of the sprite
+	registry.spriteMaskPtrs.emplace(entity, &renderer->getSpriteMask(TEXTURE_ASSET_ID::VORTEX));
+
 	// Create and (empty) Vortex component to be able to refer to all vortices.
 	registry.pits.emplace(entity);
 	registry.renderRequests.insert(
 		entity,
 		{ TEXTURE_ASSET_ID::VORTEX,
 		 EFFECT_ASSET_ID::TEXTURED,
-		 GEOMETRY_BUFFER_ID::SPRITE });
+		 GEOMETRY_BUFFER_ID::SPRITE,
+		 RENDER_LAYER::BACKGROUND }); // whatever it swallows is drawn on top
 
 	return entity;
 
 }
 
-Entity createLine(vec2 position, vec2 scale)
-{
-	Entity entity = Entity();
-
-	// Store a reference to the potentially re-used mesh object (the value is stored in the resource cache)
-	registry.renderRequests.insert(
-		entity,
-		{ TEXTURE_ASSET_ID::TEXTURE_COUNT,
-		 EFFECT_ASSET_ID::PEBBLE,
-		 GEOMETRY_BUFFER_ID::DEBUG_LINE });
-
-	// Create motion
-	Motion& motion = registry.motions.emplace(entity);
-	motion.angle = 0.f;
-	motion.velocity = { 0, 0 };
-	motion.position = position;
-	motion.scale = scale;
-
-	registry.debugComponents.emplace(entity);
-	return entity;
-}
-
 Entity createPebble(vec2 pos, vec2 size)
 {
-	auto entity = Entity();
+	auto entity = entity_pools.acquire(ARCHETYPE_ID::PEBBLE);
 
 	// Setting initial motion values
 	Motion& motion = registry.motions.emplace(entity);
 	motion.position = pos;
+	motion.prev_position = pos; // nothing to interpolate from before the first tick
 	motion.angle = 0.f;
 	motion.velocity = { 0.f, 0.f };
 	motion.scale = size;
@@ -154,11 +148,13 @@ Entity createPebble(vec2 pos, vec2 size)
 	physics.mass = 1.;
 	physics.affectedByGravity = true;
 
+	registry.lifetimes.emplace(entity).remaining_ms = PEBBLE_LIFETIME_MS;
+
 	registry.renderRequests.insert(
 		entity,
 		{ TEXTURE_ASSET_ID::TEXTURE_COUNT, // TEXTURE_COUNT indicates that no txture is needed
 			EFFECT_ASSET_ID::PEBBLE,
-			GEOMETRY_BUFFER_ID::PEBBLE });
+			GEOMETRY_BUFFER_ID::SPRITE }); // a circle on a quad, see pebble.fs.glsl
 
 	return entity;
 }
\ No newline at end of file
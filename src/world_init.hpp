@@ -12,14 +12,15 @@ const float TURTLE_BB_HEIGHT = 0.4f * 202.f;
 const float VORTEX_BB_WIDTH = 0.5f * 475.f;
 const float VORTEX_BB_HEIGHT = 0.5F * 473.f;
 
+// Pebbles that come to rest are removed after a while
+const float PEBBLE_LIFETIME_MS = 1000.f * 30;
+
 // the player
 Entity createSalmon(RenderSystem* renderer, vec2 pos);
 // the prey
 Entity createFish(RenderSystem* renderer, vec2 position);
 // the enemy
 Entity createTurtle(RenderSystem* renderer, vec2 position);
-// a red line for debugging purposes
-Entity createLine(vec2 position, vec2 size);
 // a pebble
 Entity createPebble(vec2 pos, vec2 size);
 // swallow all species within its proximity
@@ -4,10 +4,15 @@
 
 // stlib
 #include <cassert>
+#include <iomanip>
 #include <sstream>
 #include <math.h>
 
 #include "physics_system.hpp"
+#include "debug_draw.hpp"
+#include "entity_pool.hpp"
+#include "particle_pool.hpp"
+#include "spatial_index.hpp"
 
 // Game configuration
 const size_t MAX_TURTLES = 15;
@@ -15,33 +20,13 @@ const size_t MAX_FISH = 5;
 const size_t TURTLE_DELAY_MS = 1000 * 3;
 const size_t FISH_DELAY_MS = 1000 * 3;
 const size_t MAX_VORTICES = 2;
+// Entities the containers are sized for up front, fish, turtles, pebbles and the rest
+const size_t RESERVED_ENTITIES = 1024;
 const size_t VORTEX_DELAY = 5000 * 5;
 const size_t PEBBLE_DELAY_MS = 1000 * 2;
 const int NUM_DEATH_PARTICLES = 1000;
-
-namespace {
-	vec2 computeCollisionVelocity(Entity entity, Entity entity_other) {
-		auto& motion_entity = registry.motions.get(entity);
-		auto& motion_entity_other = registry.motions.get(entity_other);
-		auto& physics_entity = registry.physics.get(entity);
-		auto& physics_entity_other = registry.physics.get(entity_other);
-
-		float distSquared = (float)pow(motion_entity.position.x - motion_entity_other.position.x, 2) + pow(motion_entity.position.y - motion_entity_other.position.y, 2);
-
-		vec2 num = (motion_entity.velocity - motion_entity_other.velocity) * (motion_entity.position - motion_entity_other.position);
-		num = num / distSquared;
-		num = num * (motion_entity.position - motion_entity_other.position);
-		float coeff = (2 * physics_entity_other.mass) / (physics_entity.mass + physics_entity_other.mass);
-
-		vec2 new_velocity = motion_entity.velocity - (coeff * num);
-
-		if (physics_entity.affectedByGravity) {
-			// new_velocity *= -1.f;
-		}
-
-		return new_velocity;
-	}
-}
+const float DEATH_DURATION_MS = 3000.f;
+const float LIGHT_UP_DURATION_MS = 1000.f;
 
 // Create the fish world
 WorldSystem::WorldSystem()
@@ -50,8 +35,6 @@ WorldSystem::WorldSystem()
 	, next_fish_spawn(0.f)
 	, next_vortex_spawn(5000.f)
 	, next_pebble_spawn(0.f) {
-	// Seeding rng with random device
-	rng = std::default_random_engine(std::random_device()());
 }
 
 WorldSystem::~WorldSystem() {
@@ -96,7 +79,10 @@ GLFWwindow* WorldSystem::create_window(int width, int height) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#if GL_CHECK_ERRORS
+	// debug contexts can be slower, release builds don't ask for one
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 #if __APPLE__
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
@@ -144,12 +130,24 @@ GLFWwindow* WorldSystem::create_window(int width, int height) {
 	return window;
 }
 
-void WorldSystem::init(RenderSystem* renderer_arg) {
+void WorldSystem::init(RenderSystem* renderer_arg, WorkerPool* workers_arg) {
 	this->renderer = renderer_arg;
+	this->workers = workers_arg;
+	// Streams of the global seed, main seeds the random_service before this
+	rng = random_service.stream(RANDOM_STREAM_ID::WORLD);
+	particle_rng = random_service.stream(RANDOM_STREAM_ID::PARTICLES);
 	// Playing background music indefinitely
 	// Mix_PlayMusic(background_music, -1);
 	fprintf(stderr, "Loaded music\n");
 
+	// Size the component containers once, spawning then reuses their storage
+	entity_pools.reserve(RESERVED_ENTITIES);
+
+	// Rasterize the rotated collision masks of all sprites up front instead of on first contact
+	renderer->getSpriteMask(TEXTURE_ASSET_ID::FISH).prepare({ -FISH_BB_WIDTH, FISH_BB_HEIGHT });
+	renderer->getSpriteMask(TEXTURE_ASSET_ID::TURTLE).prepare({ -TURTLE_BB_WIDTH, TURTLE_BB_HEIGHT });
+	renderer->getSpriteMask(TEXTURE_ASSET_ID::VORTEX).prepare({ VORTEX_BB_WIDTH, VORTEX_BB_HEIGHT });
+
 	// Set all states to default
     restart_game();
 }
@@ -163,37 +161,35 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	// Updating window title with points
 	std::stringstream title_ss;
 	title_ss << "Points: " << points;
+	if (debugging.in_debug_mode) {
+		const RenderStats& stats = renderer->stats();
+		title_ss << " | draw calls: " << stats.draw_calls
+			<< " | sprite batches: " << stats.sprite_batches << " (" << stats.batched_sprites << " sprites, " << stats.batched_pebbles << " pebbles)"
+			<< " | state changes: " << stats.state_changes_issued << " issued, " << stats.state_changes_elided << " elided"
+			<< " | streamed: " << stats.streamed_bytes / 1024 << " KB, " << stats.stream_stalls << " stalls"
+			<< " | entities: " << stats.drawn_entities << " drawn, " << stats.culled_entities << " culled"
+			<< " | cpu: " << std::fixed << std::setprecision(2) << stats.cpu_frame_ms << " ms/frame, GL error checks " << (GL_CHECK_ERRORS ? "on" : "off");
+	}
 	glfwSetWindowTitle(window, title_ss.str().c_str());
 
+	// Entities despawned in the last step can be spawned again
+	entity_pools.endStep();
+
 	// Remove debug info from the last step
-	while (registry.debugComponents.entities.size() > 0)
-	    registry.remove_all_components_of(registry.debugComponents.entities.back());
-
-	// Removing out of screen entities
-	auto& motions_registry = registry.motions;
-
-	// Remove entities that leave the screen on the left side
-	// Iterate backwards to be able to remove without unterfering with the next object to visit
-	// (the containers exchange the last element with the current)
-	for (int i = (int)motions_registry.components.size()-1; i>=0; --i) {
-	    Motion& motion = motions_registry.components[i];
-		if (motion.position.x + abs(motion.scale.x) < 0.f) {
-		    registry.remove_all_components_of(motions_registry.entities[i]);
-		}
-	}
+	debug_draw.clear();
+
+	// Removing out of screen entities and the ones that expired
+	despawns.step(elapsed_ms_since_last_update, { screen_width, screen_height });
 
 	// Spawning new turtles
 	next_turtle_spawn -= elapsed_ms_since_last_update * current_speed;
 	if (registry.hardShells.components.size() <= MAX_TURTLES && next_turtle_spawn < 0.f) {
 		// Reset timer
-		next_turtle_spawn = (TURTLE_DELAY_MS / 2) + uniform_dist(rng) * (TURTLE_DELAY_MS / 2);
-		// Create turtle
-		Entity entity = createTurtle(renderer, {0,0});
-		// Setting random initial position and constant velocity
+		next_turtle_spawn = (TURTLE_DELAY_MS / 2) + rng.uniform() * (TURTLE_DELAY_MS / 2);
+		// Create turtle at a random position
+		Entity entity = createTurtle(renderer, { screen_width + 50.f, 50.f + rng.uniform() * (screen_height - 100.f) });
+		// Setting constant velocity
 		Motion& motion = registry.motions.get(entity);
-		motion.position =
-			vec2(screen_width + 50.f, 
-				 50.f + uniform_dist(rng) * (screen_height - 100.f));
 		motion.velocity = vec2(-100.f, 0.f);
 	}
 
@@ -201,22 +197,19 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	next_fish_spawn -= elapsed_ms_since_last_update * current_speed;
 	if (registry.softShells.components.size() <= MAX_FISH && next_fish_spawn < 0.f) {
 		// Reset timer
-		next_fish_spawn = (FISH_DELAY_MS / 2) + uniform_dist(rng) * (FISH_DELAY_MS / 2);
+		next_fish_spawn = (FISH_DELAY_MS / 2) + rng.uniform() * (FISH_DELAY_MS / 2);
 		// !!!  TODO A1: Create new fish with createFish({0,0}), as for the Turtles above
-		Entity entity = createFish(renderer, { screen_width + 50.f, 50.f + uniform_dist(rng) * (screen_height - 100.f) });
+		Entity entity = createFish(renderer, { screen_width + 50.f, 50.f + rng.uniform() * (screen_height - 100.f) });
 		Motion& motion = registry.motions.get(entity);
-		std::random_device rd; // obtain a random number from hardware
-		std::mt19937 gen(rd()); // seed the generator
-		std::uniform_int_distribution<> distr(-200, 200); // define the range
-		motion.velocity = vec2(-200.f, distr(gen));
+		motion.velocity = vec2(-200.f, rng.uniformInt(-200, 200));
 	}
 
 	// Spawn new Vortex
 	if (registry.mode.has(player_salmon) && registry.mode.get(player_salmon).basicMode == false) {
 		next_vortex_spawn -= elapsed_ms_since_last_update * current_speed;
 		if (registry.pits.components.size() <= MAX_VORTICES && next_vortex_spawn < 0.f) {
-			next_vortex_spawn = (VORTEX_DELAY / 2) + uniform_dist(rng) * (VORTEX_DELAY / 2);
-			Entity entity = createVortex(renderer, { screen_width + 50.f, 50.f + uniform_dist(rng) * (screen_height - 100.f) });
+			next_vortex_spawn = (VORTEX_DELAY / 2) + rng.uniform() * (VORTEX_DELAY / 2);
+			Entity entity = createVortex(renderer, { screen_width + 50.f, 50.f + rng.uniform() * (screen_height - 100.f) });
 		}
 
 		// rotate Vortex
@@ -238,29 +231,24 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	next_pebble_spawn -= elapsed_ms_since_last_update * current_speed;
 	if (next_pebble_spawn < 0.f) {
 		// Reset timer
-		next_pebble_spawn = (PEBBLE_DELAY_MS / 15) + uniform_dist(rng) * (PEBBLE_DELAY_MS / 15);
+		next_pebble_spawn = (PEBBLE_DELAY_MS / 15) + rng.uniform() * (PEBBLE_DELAY_MS / 15);
 		// next_pebble_spawn = PEBBLE_DELAY_MS / 50;
 		int w, h;
 		glfwGetWindowSize(window, &w, &h);
-		float radius = 30 * (uniform_dist(rng) + 0.3f); // range 0.3 .. 1.3
-		Entity pebble = createPebble({ uniform_dist(rng) * w, h - uniform_dist(rng) * 20 }, { radius, radius });
+		float radius = 30 * (rng.uniform() + 0.3f); // range 0.3 .. 1.3
+		Entity pebble = createPebble({ rng.uniform() * w, h - rng.uniform() * 20 }, { radius, radius });
 		auto& physicsComponent = registry.physics.get(pebble);
 		physicsComponent.mass *=  0.1* radius;
-		float brightness = uniform_dist(rng) * 0.5 + 0.5;
+		float brightness = rng.uniform() * 0.5 + 0.5;
 		registry.colors.insert(pebble, { brightness, brightness, brightness });
 		auto& motion = registry.motions.get(pebble);
 		motion.position = registry.motions.get(player_salmon).position;
+		motion.prev_position = motion.position;
 
 		
-		std::random_device rd; // obtain a random number from hardware
-		std::random_device rd2;
-		std::mt19937 gen(rd()); // seed the generator
-		std::mt19937 gen2(rd2());
-		std::uniform_int_distribution<> distr(150, 200); // define the range
-		std::uniform_int_distribution<> distr2(120, 170); // define the range
 		// float randNum = (float)((rand() % 50 - 10) * 7);
-		int randNum1 = distr(gen);
-		int randNum2 = distr2(gen2);
+		int randNum1 = rng.uniformInt(150, 200);
+		int randNum2 = rng.uniformInt(120, 170);
 		motion.velocity = vec2(randNum1, randNum2);
 		if (randNum1 % 2 == 0) {
 			motion.velocity.x *= -1.;
@@ -278,69 +266,31 @@ bool WorldSystem::step(float elapsed_ms_since_last_update) {
 	assert(registry.screenStates.components.size() <= 1);
     ScreenState &screen = registry.screenStates.components[0];
 	
-	float min_counter_ms = 3000.f;
-	for (Entity entity : registry.deathTimers.entities) {
-		// progress timer
-		DeathTimer& counter = registry.deathTimers.get(entity);
-		counter.counter_ms -= elapsed_ms_since_last_update;
-		if(counter.counter_ms < min_counter_ms){
-		    min_counter_ms = counter.counter_ms;
-		}
-
-		// restart the game once the death timer expired
-		if (counter.counter_ms < 0) {
-			registry.deathTimers.remove(entity);
-			screen.darken_screen_factor = 0;
-            restart_game();
-			return true;
-		}
-	}
-	// reduce window brightness if any of the present salmons is dying
-	screen.darken_screen_factor = 1 - min_counter_ms / 3000;
+	// Fire the timers that are due, this restarts the game once the salmon is dead
+	// and ends the light up after eating
+	timers.advance(elapsed_ms_since_last_update);
 
-	// !!! TODO A1: update LightUp timers and remove if time drops below zero, similar to the death counter
-	for (Entity entity : registry.lightUpTimers.entities) {
-		LightUpTimer& counter = registry.lightUpTimers.get(entity);
-		counter.counter_ms -= elapsed_ms_since_last_update;
+	// reduce window brightness if the salmon is dying
+	float remaining_ms = DEATH_DURATION_MS;
+	if (registry.deathTimers.has(player_salmon))
+		remaining_ms = max(0.f, registry.deathTimers.get(player_salmon).end_ms - timers.now());
+	screen.darken_screen_factor = 1 - remaining_ms / DEATH_DURATION_MS;
 
-		if (counter.counter_ms < 0) {
-			registry.lightUpTimers.remove(entity);
-		}
-	}
-
-	// update state of death particles
-	for (Entity entity : registry.deathParticles.entities) {
-		DeathParticle& deathParticles = registry.deathParticles.get(entity);
-		for (int i = 0; i < deathParticles.deathParticles.size(); i++) {
-			auto& particle = deathParticles.deathParticles[i];
-			// for (auto& particle : deathParticles.deathParticles) {
-			particle.Life -= elapsed_ms_since_last_update;
-			// if (particle.Life > 0.f) {
-			particle.motion.position.x -= particle.motion.velocity.y * (rand() % 17) * 0.3f;
-			particle.motion.position.y -= particle.motion.velocity.x * (rand() % 17) * 0.3f;
-			particle.Color.a -= 0.05f * 0.01f;
-			particle.motion.angle += 0.5;
-			if (particle.motion.angle >= (2 * M_PI)) {
-				particle.motion.angle = 0;
-			}
-			deathParticles.positions[i * 4 + 0] = particle.motion.position.x;
-			deathParticles.positions[i * 4 + 1] = particle.motion.position.y;
-			deathParticles.positions[i * 4 + 2] = 1.;
-			deathParticles.positions[i * 4 + 3] = particle.Life;
-			// }
-			if (particle.Life <= 0) {
-				deathParticles.fadedParticles++;
-			}
-		}
-		if (deathParticles.fadedParticles >= NUM_DEATH_PARTICLES - 5) {
-			deathParticles.faded = true;
-			registry.deathParticles.remove(entity);
-		}
-	}
+	// update state of death particles, on the GPU if the renderer supports it
+	particle_pool.step(elapsed_ms_since_last_update, *workers);
+	renderer->getGpuParticles().step(elapsed_ms_since_last_update, particle_rng);
 
 	return true;
 }
 
+void WorldSystem::start_dying(Entity salmon) {
+	registry.deathTimers.emplace(salmon).end_ms = timers.now() + DEATH_DURATION_MS;
+	timers.schedule(timers.now() + DEATH_DURATION_MS, [this]() {
+		registry.screenStates.components[0].darken_screen_factor = 0;
+		restart_game();
+	});
+}
+
 // Reset the world state to its initial state
 void WorldSystem::restart_game() {
 	// Debugging for memory/component leaks
@@ -353,7 +303,9 @@ void WorldSystem::restart_game() {
 	// Remove all entities that we created
 	// All that have a motion, we could also iterate over all fish, turtles, ... but that would be more cumbersome
 	while (registry.motions.entities.size() > 0)
-	    registry.remove_all_components_of(registry.motions.entities.back());
+	    entity_pools.despawn(registry.motions.entities.back());
+	spatial_index.clear();
+	timers.clear();
 
 	// Debugging for memory/component leaks
 	registry.list_all_components();
@@ -368,10 +320,10 @@ void WorldSystem::restart_game() {
 	//for (uint i = 0; i < 20; i++) {
 	//	int w, h;
 	//	glfwGetWindowSize(window, &w, &h);
-	//	float radius = 30 * (uniform_dist(rng) + 0.3f); // range 0.3 .. 1.3
-	//	Entity pebble = createPebble({ uniform_dist(rng) * w, h - uniform_dist(rng) * 20 }, 
+	//	float radius = 30 * (rng.uniform() + 0.3f); // range 0.3 .. 1.3
+	//	Entity pebble = createPebble({ rng.uniform() * w, h - rng.uniform() * 20 }, 
 	//		         { radius, radius });
-	//	float brightness = uniform_dist(rng) * 0.5 + 0.5;
+	//	float brightness = rng.uniform() * 0.5 + 0.5;
 	//	registry.colors.insert(pebble, { brightness, brightness, brightness});
 	//}
 	
@@ -385,15 +337,28 @@ void WorldSystem::handle_collisions() {
 		// The entity and its collider
 		Entity entity = collisionsRegistry.entities[i];
 		Entity entity_other = collisionsRegistry.components[i].other;
+		CONTACT_PHASE phase = collisionsRegistry.components[i].phase;
+
+		// Nothing reacts to contacts ending, and either entity may already be gone
+		if (phase == CONTACT_PHASE::END)
+			continue;
+
+		// Each pair is reported once, put the salmon first
+		if (registry.players.has(entity_other))
+			std::swap(entity, entity_other);
 
 		// For now, we are only interested in collisions that involve the salmon
 		if (registry.players.has(entity)) {
+			// ongoing overlaps were handled when the contact began
+			if (phase != CONTACT_PHASE::BEGIN)
+				continue;
+
 			// Checking Player - HardShell collisions
 			if (registry.hardShells.has(entity_other)) {
 				// initiate death unless already dying
 				if (!registry.deathTimers.has(entity)) {
 					// Scream, reset timer, and make the salmon sink
-					registry.deathTimers.emplace(entity);
+					start_dying(entity);
 					Mix_PlayChannel(-1, salmon_dead_sound, 0);
 					registry.motions.get(entity).angle = 3.1415f;
 					registry.motions.get(entity).velocity = { 0, 80 };
@@ -406,43 +371,27 @@ void WorldSystem::handle_collisions() {
 			else if (registry.softShells.has(entity_other)) {
 				if (!registry.deathTimers.has(entity)) {
 					// chew, count points, and set the LightUp timer
-					registry.remove_all_components_of(entity_other);
+					entity_pools.despawn(entity_other);
 					Mix_PlayChannel(-1, salmon_eat_sound, 0);
 					++points;
 
 					// !!! TODO A1: create a new struct called LightUp in components.hpp and add an instance to the salmon entity by modifying the ECS registry
-					registry.lightUpTimers.emplace(entity);
+					// eating again while lit up extends the light up
+					LightUpTimer& light_up = registry.lightUpTimers.has(entity) ? registry.lightUpTimers.get(entity) : registry.lightUpTimers.emplace(entity);
+					timers.cancel(light_up.removal);
+					light_up.removal = timers.scheduleRemoval(timers.now() + LIGHT_UP_DURATION_MS, entity, registry.lightUpTimers);
 					
-					if (!registry.deathParticles.has(entity)) {
-						DeathParticle particleEffects;
-						for (int p = 0; p < NUM_DEATH_PARTICLES; p++) {
-							auto& motion = registry.motions.get(entity);
-							DeathParticle particle;
-							float random1 = ((rand() % 100) - 50) / 10.0f;
-							float random2 = ((rand() % 200) - 100) / 10.0f;
-							float rColor = 0.5f + ((rand() % 100) / 100.0f);
-							// particle.motion.position = motion.position + random + vec2({ 20,20 });
-							particle.motion.position.x = motion.position.x + random1 + 20.f;
-							particle.motion.position.y = motion.position.y + random2 + 40.f;
-							particle.Color = glm::vec4(rColor, rColor, rColor, 1.0f);
-							particle.motion.velocity *= 0.1f;
-							particle.motion.scale = vec2({ 10, 10 });
-							particleEffects.deathParticles.push_back(particle);
-							particleEffects.positions[p * 4 + 0] = particle.motion.position.x;
-							particleEffects.positions[p * 4 + 1] = particle.motion.position.y;
-							particleEffects.positions[p * 4 + 2] = 1.;
-							particleEffects.positions[p * 4 + 3] = particle.Life;
-						}
-						registry.deathParticles.insert(entity, particleEffects);
-					}
+					vec2 salmon_position = registry.motions.get(entity).position;
+					if (renderer->getGpuParticles().ready())
+						renderer->getGpuParticles().emitBurst(salmon_position, NUM_DEATH_PARTICLES, particle_rng);
+					else
+						particle_pool.emitBurst(entity, salmon_position, NUM_DEATH_PARTICLES, particle_rng);
 				}
 			}
 			// Checking player - vortex collisions
 			else if (registry.pits.has(entity_other)) {
 				if (!registry.deathTimers.has(entity)) {
-					// DeathTimer t;
-					// t.counter_ms = 1500;
-					registry.deathTimers.emplace(entity);
+					start_dying(entity);
 					Mix_PlayChannel(-1, salmon_dead_sound, 0);
 					registry.colors.get(entity) = { 1.f, 0.f, 0.f };
 					registry.motions.get(entity).angle = 3.1415f;
@@ -452,36 +401,33 @@ void WorldSystem::handle_collisions() {
 					// restart_game();
 				}
 			}
-		} else if (registry.deathTimers.entities.size() <= 0 )
-			{
-			if (registry.pits.has(entity)) {
-				registry.remove_all_components_of(entity_other);
-			}
-			if (registry.pits.has(entity_other)) {
-				registry.remove_all_components_of(entity);
-			}
 		}
+	}
 
-		// handle collisions that have a physics component
-		//if (registry.physics.has(entity) && registry.physics.has(entity_other)) {
-		//	// printf("collision for physics components detected!!\n");
-
-		//	vec2 new_vel_entity = computeCollisionVelocity(entity, entity_other);
-		//	vec2 new_vel_entity_other = computeCollisionVelocity(entity_other, entity);
-
-		//	auto& motion_entity = registry.motions.get(entity);
-		//	motion_entity.velocity = new_vel_entity;
-		//	motion_entity.position = motion_entity.position +
-		//	
-		//	auto& motion_entity_other = registry.motions.get(entity_other);
-		//	motion_entity_other.velocity = new_vel_entity_other;
-
-
-		//	if (registry.hardShells.has(entity)) {
-		//		printf("velocity of pebble:%f, %f\n", motion_entity_other.velocity.x, motion_entity_other.velocity.y);
-		//		printf("velocity of turtle:%f, %f\n", motion_entity.velocity.x, motion_entity.velocity.y);
-		//	}
-		//}
+	// Vortices keep pulling in whatever overlaps them, not only new contacts. Each vortex
+	// queries its own surroundings, so it swallows regardless of which entity of a contact
+	// pair it was stored as.
+	if (registry.deathTimers.entities.size() <= 0) {
+		std::vector<Entity> vortices = registry.pits.entities;
+		for (Entity vortex : vortices) {
+			// an earlier vortex may have pulled this one in
+			if (!registry.pits.has(vortex))
+				continue;
+			Motion& vortex_motion = registry.motions.get(vortex);
+			vec2 half_extent = abs(vortex_motion.scale) / 2.f;
+			std::vector<Entity> swallowed = spatial_index.query_radius(vortex_motion.position, sqrt(dot(half_extent, half_extent)),
+				[&](Entity e) {
+					if ((unsigned int)e == (unsigned int)vortex || !registry.motions.has(e) ||
+						registry.players.has(e))
+						return false;
+					// same narrow phase as the physics pair test
+					if (registry.spriteMaskPtrs.has(vortex) && registry.spriteMaskPtrs.has(e))
+						return spriteMasksOverlap(vortex, vortex_motion, e, registry.motions.get(e));
+					return true;
+				});
+			for (Entity e : swallowed)
+				entity_pools.despawn(e);
+		}
 	}
 
 	// Remove all collisions from this simulation step
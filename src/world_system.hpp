@@ -5,13 +5,15 @@
 
 // stlib
 #include <vector>
-#include <random>
 
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 #include <SDL_mixer.h>
 
+#include "despawn_system.hpp"
+#include "random.hpp"
 #include "render_system.hpp"
+#include "worker_pool.hpp"
 
 // Container for all our entities and game logic. Individual rendering / update is
 // deferred to the relative update() methods
@@ -23,8 +25,8 @@ public:
 	// Creates a window
 	GLFWwindow* create_window(int width, int height);
 
-	// starts the game
-	void init(RenderSystem* renderer);
+	// starts the game, the particles are moved on the given workers
+	void init(RenderSystem* renderer, WorkerPool* workers);
 
 	// Releases all associated resources
 	~WorldSystem();
@@ -45,6 +47,9 @@ private:
 	// restart level
 	void restart_game();
 
+	// adds the DeathTimer and schedules the restart
+	void start_dying(Entity salmon);
+
 	// OpenGL window handle
 	GLFWwindow* window;
 
@@ -53,6 +58,7 @@ private:
 
 	// Game state
 	RenderSystem* renderer;
+	WorkerPool* workers;
 	float current_speed;
 	float next_turtle_spawn;
 	float next_fish_spawn;
@@ -61,12 +67,18 @@ private:
 	Entity player_salmon;
 	bool playerDead;
 
+	// Removes what left the screen or expired
+	DespawnSystem despawns;
+
 	// music references
 	Mix_Music* background_music;
 	Mix_Chunk* salmon_dead_sound;
 	Mix_Chunk* salmon_eat_sound;
 
-	// C++ random number generator
-	std::default_random_engine rng;
-	std::uniform_real_distribution<float> uniform_dist; // number between 0..1
+	// Gameplay timers, cleared on restart
+	TimerWheel timers;
+
+	// Random numbers for spawning, and for the death particles
+	RandomStream rng;
+	RandomStream particle_rng;
 };